@@ -1,6 +1,11 @@
-#include "ArgumentParser.h"
+﻿#include "ArgumentParser.h"
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include "../io/Decompressor.h"
+#include "../core/ThreadPlacement.h"
 
 namespace {
 std::string deriveOutputFromUrl(const std::string& url) {
@@ -17,6 +22,30 @@ std::string deriveOutputFromUrl(const std::string& url) {
 
     return name;
 }
+
+// Option values must be whole numbers in range; a typo is an error rather
+// than an exception (the daemon parses submitted jobs with this too)
+template <typename T>
+bool readNumber(const std::string& option, const char* value, T& out) {
+    const char* end = value + std::strlen(value);
+    const auto result = std::from_chars(value, end, out);
+    if (result.ec != std::errc() || result.ptr != end || result.ptr == value) {
+        std::cerr << "Invalid number for " << option << ": " << value << "\n";
+        return false;
+    }
+    return true;
+}
+
+// A mistyped list must not silently mean "no pinning"
+bool readCpuList(const std::string& option, const char* value, std::string& out) {
+    ThreadPlacement::CpuSet cpus;
+    if (!ThreadPlacement::parseCpuList(value, cpus) || cpus.empty()) {
+        std::cerr << "Invalid CPU list for " << option << ": " << value << "\n";
+        return false;
+    }
+    out = value;
+    return true;
+}
 }
 
 bool ArgumentParser::parse(int argc, char* argv[], DownloadConfig& out) {
@@ -25,10 +54,64 @@ bool ArgumentParser::parse(int argc, char* argv[], DownloadConfig& out) {
         return false;
     }
 
-    out.url.clear();
-    out.outputPath.clear();
-    out.maxThreads = 0; // 0 = auto select threads
-    out.segmentSize = 1 * 1024 * 1024;
+    out = DownloadConfig{};
+
+    bool decompress = false;
+
+    if (std::string(argv[1]) == "--make-index") {
+        if (argc < 3) {
+            printUsage();
+            return false;
+        }
+        makeIndexPath = argv[2];
+        indexBlockSize = 64 * 1024;
+        if (argc == 5 && std::string(argv[3]) == "-b") {
+            if (!readNumber(argv[3], argv[4], indexBlockSize))
+                return false;
+        }
+        else if (argc != 3) {
+            printUsage();
+            return false;
+        }
+        return indexBlockSize > 0;
+    }
+
+    if (std::string(argv[1]) == "--daemon") {
+        if (argc < 3) {
+            printUsage();
+            return false;
+        }
+        daemonSocket = argv[2];
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool ok = false;
+            if (arg == "-c" && i + 1 < argc)
+                ok = readNumber(arg, argv[++i], daemonConnections);
+            else if (arg == "-r" && i + 1 < argc)
+                ok = readNumber(arg, argv[++i], daemonBytesPerSec);
+            else if (arg == "-j" && i + 1 < argc)
+                ok = readNumber(arg, argv[++i], daemonJobs);
+            else
+                printUsage();
+            if (!ok)
+                return false;
+        }
+        return daemonConnections > 0 && daemonJobs > 0;
+    }
+
+    if (std::string(argv[1]) == "--control") {
+        if (argc < 4) {
+            printUsage();
+            return false;
+        }
+        controlSocket = argv[2];
+        for (int i = 3; i < argc; ++i) {
+            if (i > 3)
+                controlCommand += ' ';
+            controlCommand += argv[i];
+        }
+        return true;
+    }
 
     out.url = argv[1];
 
@@ -39,10 +122,111 @@ bool ArgumentParser::parse(int argc, char* argv[], DownloadConfig& out) {
             out.outputPath = argv[++i];
         }
         else if (arg == "-t" && i + 1 < argc) {
-            out.maxThreads = std::stoul(argv[++i]);
+            if (!readNumber(arg, argv[++i], out.maxThreads))
+                return false;
+        }
+        else if (arg == "-w" && i + 1 < argc) {
+            if (!readNumber(arg, argv[++i], out.writerThreads))
+                return false;
+        }
+        else if (arg == "--cpus-workers" && i + 1 < argc) {
+            if (!readCpuList(arg, argv[++i], out.workerCpus))
+                return false;
+        }
+        else if (arg == "--cpus-writers" && i + 1 < argc) {
+            if (!readCpuList(arg, argv[++i], out.writerCpus))
+                return false;
+        }
+        else if (arg == "--cpus-logger" && i + 1 < argc) {
+            if (!readCpuList(arg, argv[++i], out.loggerCpus))
+                return false;
+        }
+        else if (arg == "--nic" && i + 1 < argc) {
+            out.nicInterface = argv[++i];
+        }
+        else if (arg == "--bind" && i + 1 < argc) {
+            const std::string list = argv[++i];
+            std::size_t start = 0;
+            while (start <= list.size()) {
+                const std::size_t comma = std::min(list.find(',', start), list.size());
+                if (comma > start)
+                    out.bindInterfaces.push_back(list.substr(start, comma - start));
+                start = comma + 1;
+            }
         }
         else if (arg == "-s" && i + 1 < argc) {
-            out.segmentSize = std::stoull(argv[++i]);
+            if (!readNumber(arg, argv[++i], out.segmentSize))
+                return false;
+            out.adaptiveSegments = false;
+        }
+        else if (arg == "-S" && i + 1 < argc) {
+            if (!readNumber(arg, argv[++i], out.maxSegmentSize))
+                return false;
+        }
+        else if (arg == "--sequential" && i + 1 < argc) {
+            if (!readNumber(arg, argv[++i], out.sequentialWindow))
+                return false;
+        }
+        else if (arg == "-x") {
+            decompress = true;
+        }
+        else if (arg == "-k" && i + 1 < argc) {
+            out.keepCompressedPath = argv[++i];
+        }
+        else if (arg == "--durability" && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if (mode == "none")
+                out.durability = DurabilityMode::None;
+            else if (mode == "periodic")
+                out.durability = DurabilityMode::Periodic;
+            else if (mode == "checkpoint")
+                out.durability = DurabilityMode::Checkpoint;
+            else {
+                printUsage();
+                return false;
+            }
+        }
+        else if (arg == "--checkpoint-ms" && i + 1 < argc) {
+            if (!readNumber(arg, argv[++i], out.checkpointIntervalMs))
+                return false;
+        }
+        else if (arg == "--cache" && i + 1 < argc) {
+            out.cacheDir = argv[++i];
+        }
+        else if (arg == "--rcvbuf" && i + 1 < argc) {
+            if (!readNumber(arg, argv[++i], out.socket.receiveBuffer))
+                return false;
+        }
+        else if (arg == "--cc" && i + 1 < argc) {
+            out.socket.congestion = argv[++i];
+        }
+        else if (arg == "--keepalive" && i + 1 < argc) {
+            if (!readNumber(arg, argv[++i], out.socket.keepAliveSeconds))
+                return false;
+        }
+        else if (arg == "--low-speed" && i + 2 < argc) {
+            if (!readNumber(arg, argv[++i], out.socket.lowSpeedLimit))
+                return false;
+            if (!readNumber(arg, argv[++i], out.socket.lowSpeedSeconds))
+                return false;
+        }
+        else if (arg == "--splice") {
+            out.zeroCopy = true;
+        }
+        else if (arg == "--head") {
+            out.headFirst = true;
+        }
+        else if (arg == "--keep-cache") {
+            out.dropPageCache = false;
+        }
+        else if (arg == "--member" && i + 1 < argc) {
+            out.archiveMembers.push_back(argv[++i]);
+        }
+        else if (arg == "--delta" && i + 1 < argc) {
+            out.deltaBasePath = argv[++i];
+        }
+        else if (arg == "--delta-index" && i + 1 < argc) {
+            out.deltaIndex = argv[++i];
         }
         else {
             printUsage();
@@ -50,6 +234,32 @@ bool ArgumentParser::parse(int argc, char* argv[], DownloadConfig& out) {
         }
     }
 
+    if (decompress) {
+        std::string inner = deriveOutputFromUrl(out.url);
+        out.decompress = Decompressor::detect(inner);
+        if (out.decompress == CompressionFormat::None) {
+            std::cout << "Cannot detect compression format from url\n";
+            return false;
+        }
+        if (inner.size() > 4 && inner.compare(inner.size() - 4, 4, ".tar") == 0) {
+            out.extractTar = true;
+            inner.resize(inner.size() - 4);
+        }
+        if (out.outputPath.empty())
+            out.outputPath = inner;
+    }
+
+    if (!out.archiveMembers.empty()) {
+        if (decompress) {
+            std::cout << "--member reads the archive directly and cannot be combined with -x\n";
+            return false;
+        }
+        const std::string name = deriveOutputFromUrl(out.url);
+        out.archiveTar = name.size() > 4 && name.compare(name.size() - 4, 4, ".tar") == 0;
+        if (out.outputPath.empty())
+            out.outputPath = ".";
+    }
+
     if (out.outputPath.empty())
         out.outputPath = deriveOutputFromUrl(out.url);
 
@@ -57,15 +267,51 @@ bool ArgumentParser::parse(int argc, char* argv[], DownloadConfig& out) {
         return false;
     }
 
+    if (!out.deltaBasePath.empty() && out.deltaIndex.empty())
+        out.deltaIndex = out.url + ".mdmidx";
+
+    if (out.maxSegmentSize < out.segmentSize)
+        out.maxSegmentSize = out.segmentSize;
+
     return true;
 }
 
 void ArgumentParser::printUsage() const {
     std::cout <<
         "Usage:\n"
-        "  mdm <url> [-o <output>] [options]\n\n"
+        "  mdm <url> [-o <output>] [options]\n"
+        "  mdm --make-index <file> [-b <block bytes>]\n"
+        "  mdm --daemon <socket> [-c <connections>] [-r <bytes/s>] [-j <active jobs>]\n"
+        "  mdm --control <socket> add <priority> <url> [options] | list | cancel <id> | shutdown\n\n"
         "Options:\n"
         "  -o <file>        Output file path (default: name from url)\n"
         "  -t <threads>     Max threads (default: auto)\n"
-        "  -s <bytes>       Segment size (default: 1MB)\n";
+        "  -w <threads>     Disk writer threads, 0 = write inline (default: 2)\n"
+        "  --cpus-workers <list>  Pin download workers, e.g. 0-7,16-23\n"
+        "  --cpus-writers <list>  Pin disk writer threads\n"
+        "  --cpus-logger <list>   Pin the logger thread\n"
+        "  --nic <iface>    Place workers, writers and buffers on this NIC's NUMA node\n"
+        "  --bind <list>    Spread connections over these interfaces or source addresses,\n"
+        "                   e.g. eth0,eth1 or 127.0.0.2,127.0.0.3 (repeatable)\n"
+        "  -s <bytes>       Fixed segment size (default: adaptive)\n"
+        "  -S <bytes>       Max adaptive segment size (default: 64MB)\n"
+        "  --sequential <bytes>  Download in order within this window and publish the\n"
+        "                   complete prefix in <output>.prefix\n"
+        "  -x               Decompress .gz/.zst (and extract .tar) while downloading\n"
+        "  -k <file>        With -x, also keep the compressed file\n"
+        "  --member <name>  Fetch only this member of a remote .zip or .tar (repeatable;\n"
+        "                   a name ending in / selects a folder); -o is then the target directory\n"
+        "  --durability <none|periodic|checkpoint>  Sync policy for data and resume file (default: periodic)\n"
+        "  --checkpoint-ms <ms>  Periodic commit interval (default: 5000)\n"
+        "  --keep-cache     Leave downloaded data in the page cache\n"
+        "  --splice         Move http:// bodies from socket to file with splice() (Linux)\n"
+        "  --rcvbuf <bytes> Socket receive buffer (default: kernel autotuning)\n"
+        "  --cc <name>      TCP congestion control, e.g. bbr (Linux)\n"
+        "  --keepalive <s>  TCP keepalive idle time\n"
+        "  --low-speed <bytes/s> <s>  Abort transfers slower than this for that long\n"
+        "  --cache <dir>    Reuse and record completed downloads in this directory\n"
+        "  --head           Ask for size and ETag with HEAD first (for servers that\n"
+        "                   mishandle ranged GETs)\n"
+        "  --delta <file>   Reuse matching blocks of a previous local version\n"
+        "  --delta-index <path|url>  Block index of the remote file (default: <url>.mdmidx)\n";
 }
@@ -6,6 +6,20 @@ class ArgumentParser {
 public:
     bool parse(int argc, char* argv[], DownloadConfig& out);
 
+    // Set when invoked as `mdm --make-index <file> [-b <bytes>]`
+    std::string makeIndexPath;
+    std::uint64_t indexBlockSize{ 0 };
+
+    // Set when invoked as `mdm --daemon <socket> [-c <n>] [-r <bytes/s>] [-j <n>]`
+    std::string daemonSocket;
+    std::size_t daemonConnections{ 16 };
+    std::uint64_t daemonBytesPerSec{ 0 };
+    std::size_t daemonJobs{ 4 };
+
+    // Set when invoked as `mdm --control <socket> <command...>`
+    std::string controlSocket;
+    std::string controlCommand;
+
 private:
     void printUsage() const;
 };
@@ -0,0 +1,282 @@
+#include "ArchivePlanner.h"
+#include "../net/HttpClient.h"
+
+#include <algorithm>
+
+namespace {
+// Local headers are re-read for their name and extra lengths; this margin
+// usually covers both so one range per member is enough
+constexpr std::uint64_t kLocalHeaderRead = ZipDirectory::kLocalHeaderSize + 512;
+// Local header reads per multi-range request
+constexpr std::size_t kHeaderBatch = 64;
+constexpr std::uint64_t kTarWindow = 64 * 1024;
+constexpr std::uint64_t kMaxDirectorySize = 256ull * 1024 * 1024;
+constexpr std::uint64_t kMaxLongName = 64 * 1024;
+}
+
+ArchivePlanner::ArchivePlanner(HttpClient& client, std::uint64_t fileSize)
+    : http(client), total(fileSize) {
+}
+
+bool ArchivePlanner::plan(const std::vector<std::string>& wanted, bool tar) {
+    list.clear();
+    unmatched.clear();
+    hit.assign(wanted.size(), false);
+    readBytes = 0;
+    multiRange = true;
+
+    if (!(tar ? planTar(wanted) : planZip(wanted)))
+        return false;
+
+    for (std::size_t i = 0; i < wanted.size(); ++i) {
+        if (!hit[i])
+            unmatched.push_back(wanted[i]);
+    }
+    std::sort(list.begin(), list.end(), [](const ArchiveMember& a, const ArchiveMember& b) {
+        return a.dataOffset < b.dataOffset;
+    });
+    return true;
+}
+
+bool ArchivePlanner::planZip(const std::vector<std::string>& wanted) {
+    const std::uint64_t tailSize = std::min<std::uint64_t>(total, ZipDirectory::kMaxEndSize);
+    std::string tail;
+    if (!fetch(total - tailSize, tailSize, tail))
+        return false;
+
+    ZipDirectory::End end;
+    if (!ZipDirectory::findEnd(tail.data(), tail.size(), end))
+        return fail("No ZIP end of central directory record");
+
+    if (end.zip64) {
+        std::string rec;
+        if (end.zip64RecordOffset + ZipDirectory::kZip64EndSize > total
+            || !fetch(end.zip64RecordOffset, ZipDirectory::kZip64EndSize, rec)
+            || !ZipDirectory::parseZip64End(rec.data(), rec.size(), end))
+            return fail("Bad ZIP64 end of central directory record");
+    }
+
+    if (end.cdSize > kMaxDirectorySize || end.cdOffset + end.cdSize > total)
+        return fail("ZIP central directory out of range");
+
+    std::string cd;
+    ZipDirectory dir;
+    if (!fetch(end.cdOffset, end.cdSize, cd) || !dir.parse(cd.data(), cd.size()))
+        return fail("Bad ZIP central directory");
+
+    std::vector<const ZipEntry*> selected;
+    std::vector<ByteRange> headers;
+    for (const ZipEntry& e : dir.entries()) {
+        if (e.name.empty() || e.name.back() == '/' || !matches(wanted, e.name))
+            continue;
+        if (e.flags & 1)
+            return fail("Encrypted ZIP member: " + e.name);
+        if (e.method != 0 && e.method != 8)
+            return fail("Unsupported ZIP compression method " + std::to_string(e.method) + ": " + e.name);
+        if (e.localHeaderOffset >= total)
+            return fail("Bad ZIP local header: " + e.name);
+
+        selected.push_back(&e);
+        headers.push_back({ e.localHeaderOffset, std::min(kLocalHeaderRead, total - e.localHeaderOffset) });
+    }
+
+    // The data offset depends on the local header's own name and extra
+    // lengths, which the central directory does not repeat
+    std::vector<std::string> locals;
+    if (!fetchMany(headers, locals))
+        return false;
+
+    for (std::size_t i = 0; i < selected.size(); ++i) {
+        const ZipEntry& e = *selected[i];
+        std::uint64_t headerLength = 0;
+        if (!ZipDirectory::localHeaderLength(locals[i].data(), locals[i].size(), headerLength))
+            return fail("Bad ZIP local header: " + e.name);
+
+        ArchiveMember m;
+        m.name = e.name;
+        m.dataOffset = e.localHeaderOffset + headerLength;
+        m.storedSize = e.compressedSize;
+        m.size = e.size;
+        m.format = e.method == 8 ? CompressionFormat::Deflate : CompressionFormat::None;
+        if (m.dataOffset + m.storedSize > total)
+            return fail("ZIP member out of range: " + e.name);
+        list.push_back(m);
+    }
+    return true;
+}
+
+bool ArchivePlanner::planTar(const std::vector<std::string>& wanted) {
+    const std::size_t kBlock = TarFormat::kBlock;
+    std::string window;
+    std::uint64_t windowBase = 0;
+
+    // One header block at pos, refilling the window as the walk moves on
+    auto block = [&](std::uint64_t pos, const char*& out) {
+        if (pos < windowBase || pos + kBlock > windowBase + window.size()) {
+            const std::uint64_t n = std::min(kTarWindow, total - pos);
+            if (n < kBlock || !fetch(pos, n, window))
+                return false;
+            windowBase = pos;
+        }
+        out = window.data() + (pos - windowBase);
+        return true;
+    };
+
+    std::string pendingName;
+    std::uint64_t pos = 0;
+    while (pos + kBlock <= total) {
+        if (std::all_of(hit.begin(), hit.end(), [](bool b) { return b; })
+            && !std::any_of(wanted.begin(), wanted.end(), [](const std::string& w) { return !w.empty() && w.back() == '/'; }))
+            break;
+
+        const char* raw = nullptr;
+        if (!block(pos, raw))
+            return fail("Truncated tar header");
+        if (TarFormat::isEndBlock(raw))
+            break;
+
+        TarHeader h;
+        if (!TarFormat::parseHeader(raw, h))
+            return fail("Bad tar header checksum");
+
+        const std::uint64_t data = pos + kBlock;
+        const std::uint64_t next = data + h.size + TarFormat::padding(h.size);
+        if (next > total)
+            return fail("Tar member out of range: " + h.name);
+
+        if (h.type == 'L' || h.type == 'x') {
+            if (h.size > kMaxLongName)
+                return fail("Tar extended header too large");
+            std::string body;
+            if (!fetch(data, h.size, body))
+                return false;
+            if (h.type == 'L') {
+                pendingName.assign(body.c_str());
+            }
+            else {
+                const std::string path = TarFormat::paxPath(body);
+                if (!path.empty())
+                    pendingName = path;
+            }
+            pos = next;
+            continue;
+        }
+
+        const std::string name = pendingName.empty() ? h.name : pendingName;
+        pendingName.clear();
+
+        const bool regular = h.type == '0' || h.type == '\0' || h.type == '7';
+        if (regular && matches(wanted, name)) {
+            ArchiveMember m;
+            m.name = name;
+            m.dataOffset = data;
+            m.storedSize = h.size;
+            m.size = h.size;
+            list.push_back(m);
+        }
+        pos = next;
+    }
+    return true;
+}
+
+bool ArchivePlanner::fetch(std::uint64_t offset, std::uint64_t size, std::string& out) {
+    out.clear();
+    if (size == 0)
+        return true;
+    out.reserve(static_cast<std::size_t>(size));
+    const bool ok = http.getRange(offset, size, [&out](const char* data, std::size_t n) {
+        out.append(data, n);
+        return true;
+    });
+    readBytes += out.size();
+    if (!ok || out.size() != size)
+        return fail("Range read failed at offset " + std::to_string(offset));
+    return true;
+}
+
+bool ArchivePlanner::fetchMany(const std::vector<ByteRange>& ranges, std::vector<std::string>& out) {
+    out.assign(ranges.size(), std::string());
+
+    for (std::size_t first = 0; first < ranges.size(); first += kHeaderBatch) {
+        const std::size_t last = std::min(ranges.size(), first + kHeaderBatch);
+
+        if (multiRange && last - first > 1) {
+            const std::vector<ByteRange> batch(ranges.begin() + first, ranges.begin() + last);
+            // Parts may be coalesced or overlap; each range takes the bytes
+            // that continue it
+            const MultiRangeResult result = http.getRanges(batch,
+                [&](std::uint64_t offset, const char* data, std::size_t n) {
+                    readBytes += n;
+                    for (std::size_t i = first; i < last; ++i) {
+                        std::string& buf = out[i];
+                        const std::uint64_t at = ranges[i].offset + buf.size();
+                        const std::uint64_t end = std::min(ranges[i].offset + ranges[i].size, offset + n);
+                        if (at >= offset && at < end)
+                            buf.append(data + (at - offset), static_cast<std::size_t>(end - at));
+                    }
+                    return true;
+                });
+            // One part for everything is fine if it covered every range
+            if (result == MultiRangeResult::Unsupported
+                || (result == MultiRangeResult::SinglePart && std::any_of(out.begin() + first, out.begin() + last,
+                    [](const std::string& buf) { return buf.empty(); })))
+                multiRange = false;
+        }
+
+        // Whatever the server left out is read one range at a time
+        for (std::size_t i = first; i < last; ++i) {
+            if (out[i].size() != ranges[i].size && !fetch(ranges[i].offset, ranges[i].size, out[i]))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ArchivePlanner::matches(const std::vector<std::string>& wanted, const std::string& name) {
+    bool any = false;
+    for (std::size_t i = 0; i < wanted.size(); ++i) {
+        const std::string& w = wanted[i];
+        const bool ok = (!w.empty() && w.back() == '/')
+            ? name.compare(0, w.size(), w) == 0
+            : name == w;
+        if (ok) {
+            hit[i] = true;
+            any = true;
+        }
+    }
+    return any;
+}
+
+bool ArchivePlanner::fail(const std::string& msg) {
+    lastError = msg;
+    return false;
+}
+
+const std::vector<ArchiveMember>& ArchivePlanner::members() const {
+    return list;
+}
+
+std::vector<std::string> ArchivePlanner::missing() const {
+    return unmatched;
+}
+
+RangeSet ArchivePlanner::unwanted() const {
+    RangeSet done;
+    std::uint64_t from = 0;
+    for (const ArchiveMember& m : list) {
+        if (m.dataOffset > from)
+            done.add(from, m.dataOffset);
+        from = std::max(from, m.dataOffset + m.storedSize);
+    }
+    if (from < total)
+        done.add(from, total);
+    return done;
+}
+
+std::uint64_t ArchivePlanner::metadataBytes() const {
+    return readBytes;
+}
+
+const std::string& ArchivePlanner::error() const {
+    return lastError;
+}
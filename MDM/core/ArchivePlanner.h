@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "utils.h"
+#include "../io/ArchiveFormat.h"
+
+class HttpClient;
+struct ByteRange;
+
+// Finds where selected members of a remote ZIP or uncompressed tar live
+// using small range reads (end record and central directory, or the tar
+// headers), so only their data has to be downloaded.
+class ArchivePlanner {
+public:
+    ArchivePlanner(HttpClient& client, std::uint64_t fileSize);
+
+    // A wanted name ending in '/' selects everything below it
+    bool plan(const std::vector<std::string>& wanted, bool tar);
+
+    const std::vector<ArchiveMember>& members() const;
+    // Wanted names that matched nothing
+    std::vector<std::string> missing() const;
+    // Everything outside the members' data, as done ranges for the queue
+    RangeSet unwanted() const;
+    // Bytes read to plan, outside the download itself
+    std::uint64_t metadataBytes() const;
+    const std::string& error() const;
+
+private:
+    bool planZip(const std::vector<std::string>& wanted);
+    bool planTar(const std::vector<std::string>& wanted);
+    bool fetch(std::uint64_t offset, std::uint64_t size, std::string& out);
+    // Several small reads, as multi-range requests where the server allows
+    bool fetchMany(const std::vector<ByteRange>& ranges, std::vector<std::string>& out);
+    bool matches(const std::vector<std::string>& wanted, const std::string& name);
+    bool fail(const std::string& msg);
+
+private:
+    HttpClient& http;
+    std::uint64_t total;
+    std::vector<ArchiveMember> list;
+    std::vector<std::string> unmatched;
+    std::vector<bool> hit;
+    std::uint64_t readBytes = 0;
+    bool multiRange = true;
+    std::string lastError;
+};
@@ -0,0 +1,112 @@
+#include "Checkpointer.h"
+
+Checkpointer::Checkpointer(DurabilityMode mode,
+    std::chrono::milliseconds interval,
+    OutputSink& sink,
+    SegmentQueue& queue,
+    MetadataStore& store,
+    const DownloadMetadata& header)
+    : durability(mode),
+    period(interval),
+    outputSink(sink),
+    segmentQueue(queue),
+    metadataStore(store) {
+    snapshot.url = header.url;
+    snapshot.etag = header.etag;
+    snapshot.fileSize = header.fileSize;
+    snapshot.completedBytes = 0;
+}
+
+Checkpointer::~Checkpointer() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    cv.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+void Checkpointer::start() {
+    if (durability == DurabilityMode::None)
+        return;
+
+    running = true;
+    worker = std::thread(&Checkpointer::run, this);
+}
+
+void Checkpointer::onSegmentDone() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ++completions;
+    }
+    if (durability == DurabilityMode::Checkpoint)
+        cv.notify_one();
+}
+
+void Checkpointer::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (running) {
+        if (durability == DurabilityMode::Checkpoint) {
+            cv.wait(lock, [&]() { return !running || completions != committedCompletions; });
+        }
+        else {
+            cv.wait_for(lock, period, [&]() { return !running; });
+        }
+
+        if (!running || completions == committedCompletions)
+            continue;
+
+        const std::uint64_t upTo = completions;
+        lock.unlock();
+        commit();
+        lock.lock();
+        committedCompletions = upTo;
+    }
+}
+
+bool Checkpointer::commit() {
+    // 1. Which ranges are done right now. Workers drain their data to the
+    //    sink before marking a segment done, so all of it is in the file.
+    segmentQueue.snapshot(snapshot.done);
+    snapshot.completedBytes = snapshot.done.bytes();
+
+    const bool durable = durability != DurabilityMode::None;
+
+    // 2. Those bytes reach the disk...
+    if (durable) {
+        const auto t0 = std::chrono::steady_clock::now();
+        const bool synced = outputSink.sync();
+        syncNanos.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0).count()), std::memory_order_relaxed);
+        if (!synced)
+            return false;
+    }
+
+    // 3. ...before the metadata that claims them does
+    if (!metadataStore.save(snapshot, durable))
+        return false;
+
+    commits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool Checkpointer::stop(bool finalCommit) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    cv.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    return !finalCommit || commit();
+}
+
+std::uint64_t Checkpointer::commitCount() const {
+    return commits.load(std::memory_order_relaxed);
+}
+
+double Checkpointer::syncSeconds() const {
+    return static_cast<double>(syncNanos.load(std::memory_order_relaxed)) / 1e9;
+}
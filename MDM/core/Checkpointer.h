@@ -0,0 +1,57 @@
+#pragma once
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+#include "utils.h"
+#include "SegmentQueue.h"
+#include "../io/OutputSink.h"
+#include "../io/MetadataStore.h"
+
+// Group commit of data and resume metadata. A commit snapshots the segment
+// states first, then syncs the data file, then durably replaces the
+// metadata file, so a segment can only be recorded as done after its bytes
+// are on disk. Segments finishing while a commit runs are picked up by the
+// next one, which is what batches many completions into one fdatasync.
+class Checkpointer {
+public:
+    Checkpointer(DurabilityMode mode,
+        std::chrono::milliseconds interval,
+        OutputSink& sink,
+        SegmentQueue& queue,
+        MetadataStore& store,
+        const DownloadMetadata& header);
+    ~Checkpointer();
+
+    void start();
+    void onSegmentDone();
+    // Stops the commit thread, then writes a final checkpoint if asked to
+    bool stop(bool finalCommit);
+
+    std::uint64_t commitCount() const;
+    double syncSeconds() const;
+
+private:
+    void run();
+    bool commit();
+
+private:
+    DurabilityMode durability;
+    std::chrono::milliseconds period;
+    OutputSink& outputSink;
+    SegmentQueue& segmentQueue;
+    MetadataStore& metadataStore;
+    DownloadMetadata snapshot;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool running{ false };
+    std::uint64_t completions{ 0 };
+    std::uint64_t committedCompletions{ 0 };
+    std::thread worker;
+
+    std::atomic<std::uint64_t> commits{ 0 };
+    std::atomic<std::uint64_t> syncNanos{ 0 };
+};
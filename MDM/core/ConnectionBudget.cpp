@@ -0,0 +1,55 @@
+#include "ConnectionBudget.h"
+
+#include <chrono>
+
+namespace {
+// Waiters recheck their stop flag this often
+constexpr auto kStopPoll = std::chrono::milliseconds(100);
+}
+
+ConnectionBudget::ConnectionBudget(std::size_t slots)
+    : total(slots == 0 ? 1 : slots) {
+}
+
+bool ConnectionBudget::acquire(int priority, const std::atomic<bool>& stop) {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    // Negated arrival so that, within a priority, the earliest is last
+    const auto key = std::make_pair(priority, -(arrivals++));
+    waiting.insert(key);
+
+    for (;;) {
+        if (stop.load(std::memory_order_relaxed)) {
+            waiting.erase(key);
+            cv.notify_all();
+            return false;
+        }
+        if (used < total && *waiting.rbegin() == key)
+            break;
+        cv.wait_for(lock, kStopPoll);
+    }
+
+    waiting.erase(key);
+    ++used;
+    // The next waiter may fit as well
+    cv.notify_all();
+    return true;
+}
+
+void ConnectionBudget::release() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (used > 0)
+            --used;
+    }
+    cv.notify_all();
+}
+
+std::size_t ConnectionBudget::inUse() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return used;
+}
+
+std::size_t ConnectionBudget::capacity() const {
+    return total;
+}
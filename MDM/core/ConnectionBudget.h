@@ -0,0 +1,32 @@
+#pragma once
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+
+// Connection slots shared by several downloads. Workers hold a slot for
+// one segment at a time; a freed slot goes to the highest-priority waiter
+// (first come within a priority), so a more important download takes
+// connections over from others at their next segment boundary.
+class ConnectionBudget {
+public:
+    explicit ConnectionBudget(std::size_t slots);
+
+    // Blocks until a slot is granted; false if `stop` became true first
+    bool acquire(int priority, const std::atomic<bool>& stop);
+    void release();
+
+    std::size_t inUse() const;
+    std::size_t capacity() const;
+
+private:
+    std::size_t total;
+    std::size_t used{ 0 };
+    // (priority, arrival) of waiting workers; the last key is served next
+    std::set<std::pair<int, std::int64_t>> waiting;
+    std::int64_t arrivals{ 0 };
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+};
@@ -1,19 +1,141 @@
 #include "ConnectionPool.h"
 
-ConnectionPool::ConnectionPool(const std::string& u, std::size_t maxSize)
-    : url(u), maxPoolSize(maxSize) {
+namespace {
+// Weight of the newest transfer in an interface's smoothed rate
+constexpr double kRateAlpha = 0.3;
+// Transfers shorter than this say more about latency than bandwidth, so
+// they are pooled per path until together they span at least this long
+constexpr double kMinRateSeconds = 0.05;
+// Consecutive failed transfers before a path is backed off; a failed
+// connect backs it off at once
+constexpr unsigned kMaxFailStreak = 3;
+constexpr auto kMinBackoff = std::chrono::seconds(1);
+constexpr auto kMaxBackoff = std::chrono::seconds(60);
+}
+
+ConnectionPool::ConnectionPool(const std::string& u, std::size_t maxSize,
+    const std::vector<std::string>& interfaces)
+    : maxPoolSize(maxSize), url(u) {
+    // The default route is a single unnamed path
+    if (interfaces.empty())
+        paths.resize(1);
+    for (const auto& name : interfaces) {
+        paths.emplace_back();
+        paths.back().name = name;
+    }
+}
+
+std::size_t ConnectionPool::pickPath() const {
+    if (paths.size() == 1)
+        return 0;
+
+    // Paths backed off after failures sit out until retryAt, and then get
+    // a single trial connection until one succeeds
+    const auto now = std::chrono::steady_clock::now();
+    auto usable = [&](const Path& p) {
+        return p.failStreak == 0 || (now >= p.retryAt && p.inUse == 0);
+    };
+
+    // An unmeasured path is assumed as fast as the average measured one, so
+    // it gets tried without crowding out paths known to work
+    double rateSum = 0.0;
+    std::size_t measured = 0;
+    for (const Path& p : paths) {
+        if (usable(p) && p.rate > 0.0) {
+            rateSum += p.rate;
+            ++measured;
+        }
+    }
+    const double prior = measured > 0 ? rateSum / static_cast<double>(measured) : 1.0;
+
+    // The path where one more connection gets the largest share of its rate
+    std::size_t best = paths.size();
+    double bestScore = -1.0;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        const Path& p = paths[i];
+        if (!usable(p))
+            continue;
+        const double score = (p.rate > 0.0 ? p.rate : prior) / static_cast<double>(p.inUse + 1);
+        if (score > bestScore) {
+            bestScore = score;
+            best = i;
+        }
+    }
+    if (best < paths.size())
+        return best;
+
+    // Everything is backed off: the path due back first
+    best = 0;
+    for (std::size_t i = 1; i < paths.size(); ++i) {
+        if (paths[i].retryAt < paths[best].retryAt)
+            best = i;
+    }
+    return best;
+}
+
+void ConnectionPool::recordOutcome(Path& path, const HttpTransferStats& stats) {
+    if (!stats.failed) {
+        if (stats.bytes > 0)
+            path.failStreak = 0;
+        return;
+    }
+
+    ++path.failures;
+    ++path.failStreak;
+    if (!stats.connectFailed && path.failStreak < kMaxFailStreak)
+        return;
+
+    // Doubles with every further failure
+    const unsigned doublings = std::min(path.failStreak > kMaxFailStreak ? path.failStreak - kMaxFailStreak : 0u, 6u);
+    auto backoff = std::chrono::duration_cast<std::chrono::steady_clock::duration>(kMinBackoff) * (1u << doublings);
+    backoff = std::min<std::chrono::steady_clock::duration>(backoff, kMaxBackoff);
+    path.retryAt = std::chrono::steady_clock::now() + backoff;
+}
+
+ConnectionPool::Path* ConnectionPool::findPath(const std::string& name) {
+    for (auto& p : paths) {
+        if (p.name == name)
+            return &p;
+    }
+    return nullptr;
+}
+
+void ConnectionPool::setZeroCopy(bool enabled) {
+    std::lock_guard<std::mutex> lock(mtx);
+    zeroCopy = enabled;
+}
+
+void ConnectionPool::setSocketOptions(const SocketOptions* options) {
+    std::lock_guard<std::mutex> lock(mtx);
+    socketOptions = options;
+}
+
+void ConnectionPool::setShare(void* share) {
+    std::lock_guard<std::mutex> lock(mtx);
+    shareHandle = share;
 }
 
 std::unique_ptr<HttpClient> ConnectionPool::acquire() {
     std::lock_guard<std::mutex> lock(mtx);
 
-    if (!pool.empty()) {
-        auto client = std::move(pool.front());
-        pool.pop();
-        return client;
-    }
+    Path& path = paths[pickPath()];
+    ++path.inUse;
 
-    return std::make_unique<HttpClient>(url);
+    std::unique_ptr<HttpClient> client;
+    if (!path.idle.empty()) {
+        client = std::move(path.idle.front());
+        path.idle.pop();
+        --idleCount;
+    }
+    else {
+        client = std::make_unique<HttpClient>(url);
+        client->setInterface(path.name);
+        client->setZeroCopy(zeroCopy);
+        client->setSocketOptions(socketOptions);
+        client->setShare(shareHandle);
+    }
+    leased.insert(client.get());
+    return client;
 }
 
 void ConnectionPool::release(std::unique_ptr<HttpClient> client) {
@@ -22,7 +144,69 @@ void ConnectionPool::release(std::unique_ptr<HttpClient> client) {
 
     std::lock_guard<std::mutex> lock(mtx);
 
-    if (pool.size() < maxPoolSize) {
-        pool.push(std::move(client));
+    // Clients made elsewhere (e.g. the first request) may not match a path
+    Path* path = findPath(client->interfaceName());
+    if (!path) {
+        leased.erase(client.get());
+        return;
     }
+
+    if (leased.erase(client.get()) > 0 && path->inUse > 0)
+        --path->inUse;
+
+    const auto& stats = client->lastStats();
+    path->bytes += stats.bytes;
+    recordOutcome(*path, stats);
+
+    ConnectionSample& sample = samples[client.get()];
+    sample.interfaceName = path->name;
+    sample.bytes += stats.bytes;
+    if (stats.tcp.valid)
+        sample.tcp = stats.tcp;
+    if (stats.bytes > 0 && stats.totalSeconds > 0.0) {
+        path->pendingBytes += stats.bytes;
+        path->pendingSeconds += stats.totalSeconds;
+    }
+    if (path->pendingSeconds >= kMinRateSeconds) {
+        const double rate = static_cast<double>(path->pendingBytes) / path->pendingSeconds;
+        path->rate = path->rate == 0.0 ? rate : path->rate + kRateAlpha * (rate - path->rate);
+        path->pendingBytes = 0;
+        path->pendingSeconds = 0.0;
+    }
+
+    if (idleCount < maxPoolSize) {
+        path->idle.push(std::move(client));
+        ++idleCount;
+        return;
+    }
+
+    // The address may be reused by a later client
+    auto it = samples.find(client.get());
+    retired.push_back(it->second);
+    samples.erase(it);
+}
+
+std::vector<ConnectionPool::InterfaceStats> ConnectionPool::interfaceStats() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<InterfaceStats> out;
+    for (const auto& p : paths)
+        out.push_back({ p.name, p.bytes, p.rate, p.failures });
+    return out;
+}
+
+bool ConnectionPool::hasHealthyPath() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto& p : paths) {
+        if (p.failStreak == 0 && p.bytes > 0)
+            return true;
+    }
+    return false;
+}
+
+std::vector<ConnectionPool::ConnectionSample> ConnectionPool::connectionSamples() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<ConnectionSample> out = retired;
+    for (const auto& entry : samples)
+        out.push_back(entry.second);
+    return out;
 }
@@ -1,21 +1,86 @@
 #pragma once
 #include <queue>
+#include <deque>
+#include <vector>
 #include <memory>
 #include <mutex>
+#include <chrono>
+#include <unordered_set>
+#include <unordered_map>
 #include <condition_variable>
 
 #include "../net/HttpClient.h"
 
 class ConnectionPool {
 public:
-    ConnectionPool(const std::string& url, std::size_t maxSize);
+    // With several interfaces (names or source addresses) connections are
+    // spread across them, weighted by the throughput each one delivers. A
+    // path that cannot connect, or keeps failing, is left alone for a
+    // growing back-off period.
+    ConnectionPool(const std::string& url, std::size_t maxSize,
+        const std::vector<std::string>& interfaces = {});
+
+    // Apply to clients created from now on
+    void setZeroCopy(bool enabled);
+    void setSocketOptions(const SocketOptions* options);
+    void setShare(void* share);
 
     std::unique_ptr<HttpClient> acquire();
+    // Also credits the client's last transfer (or failure) to its interface
     void release(std::unique_ptr<HttpClient> client);
 
+    struct InterfaceStats {
+        std::string name;
+        std::uint64_t bytes;
+        double bytesPerSec; // per connection, smoothed
+        std::uint64_t failures;
+    };
+    std::vector<InterfaceStats> interfaceStats() const;
+    // Some path's last transfer succeeded; a failed connect elsewhere is
+    // then the path's fault rather than the request's
+    bool hasHealthyPath() const;
+
+    // Latest TCP_INFO of every client the pool handed out
+    struct ConnectionSample {
+        std::string interfaceName;
+        std::uint64_t bytes = 0;
+        TcpSample tcp;
+    };
+    std::vector<ConnectionSample> connectionSamples() const;
+
+private:
+    struct Path {
+        std::string name;
+        std::queue<std::unique_ptr<HttpClient>> idle;
+        std::size_t inUse{ 0 };
+        std::uint64_t bytes{ 0 };
+        double rate{ 0.0 };
+        // Short transfers accumulate here until they span kMinRateSeconds
+        std::uint64_t pendingBytes{ 0 };
+        double pendingSeconds{ 0.0 };
+        std::uint64_t failures{ 0 };
+        // Failures since the last success; not picked before retryAt
+        unsigned failStreak{ 0 };
+        std::chrono::steady_clock::time_point retryAt{};
+    };
+
+    std::size_t pickPath() const;
+    void recordOutcome(Path& path, const HttpTransferStats& stats);
+    Path* findPath(const std::string& name);
+
 private:
     std::size_t maxPoolSize;
     std::string url;
-    std::queue<std::unique_ptr<HttpClient>> pool;
-    std::mutex mtx;
+    // deque: paths own move-only queues and are never relocated
+    std::deque<Path> paths;
+    std::size_t idleCount{ 0 };
+    bool zeroCopy{ false };
+    const SocketOptions* socketOptions{ nullptr };
+    void* shareHandle{ nullptr };
+    // Clients still alive by address; dropped ones move to retired
+    std::unordered_map<const HttpClient*, ConnectionSample> samples;
+    std::vector<ConnectionSample> retired;
+    // Clients handed out by acquire() and not yet back
+    std::unordered_set<const HttpClient*> leased;
+    mutable std::mutex mtx;
 };
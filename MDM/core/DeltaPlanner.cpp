@@ -0,0 +1,145 @@
+#include "DeltaPlanner.h"
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+constexpr std::size_t kScanBuffer = 8 * 1024 * 1024;
+}
+
+DeltaPlanner::DeltaPlanner(const BlockIndex& index)
+    : blockIndex(index), matches(index.blocks.size(), -1) {
+}
+
+bool DeltaPlanner::scan(const std::string& localPath) {
+    std::ifstream in(localPath, std::ios::binary);
+    if (!in.is_open())
+        return false;
+    basePath = localPath;
+
+    const std::size_t bs = static_cast<std::size_t>(blockIndex.blockSize);
+
+    // Only full blocks take part; the short tail block is always fetched
+    std::size_t fullBlocks = blockIndex.blocks.size();
+    if (fullBlocks > 0 && blockIndex.fileLength % blockIndex.blockSize != 0)
+        --fullBlocks;
+
+    std::unordered_map<std::uint32_t, std::vector<std::size_t>> byWeak;
+    byWeak.reserve(fullBlocks);
+    for (std::size_t i = 0; i < fullBlocks; ++i)
+        byWeak[blockIndex.blocks[i].weak].push_back(i);
+
+    if (byWeak.empty())
+        return true;
+
+    std::vector<unsigned char> buf(std::max(kScanBuffer, 2 * bs + 1));
+    std::size_t filled = 0;
+    std::size_t pos = 0;
+    std::uint64_t bufBase = 0; // file offset of buf[0]
+    bool eof = false;
+    bool haveSum = false;
+    RollingChecksum sum;
+    std::size_t remaining = fullBlocks;
+
+    auto refill = [&]() {
+        if (pos > 0) {
+            std::memmove(buf.data(), buf.data() + pos, filled - pos);
+            filled -= pos;
+            bufBase += pos;
+            pos = 0;
+        }
+        in.read(reinterpret_cast<char*>(buf.data() + filled), static_cast<std::streamsize>(buf.size() - filled));
+        const std::size_t n = static_cast<std::size_t>(in.gcount());
+        filled += n;
+        if (n == 0)
+            eof = true;
+    };
+
+    while (remaining > 0) {
+        // Need the window plus one byte to roll
+        if (pos + bs + 1 > filled && !eof)
+            refill();
+        if (pos + bs > filled)
+            break;
+
+        if (!haveSum) {
+            sum.reset(buf.data() + pos, bs);
+            haveSum = true;
+        }
+
+        bool matched = false;
+        auto it = byWeak.find(sum.value());
+        if (it != byWeak.end()) {
+            const std::uint64_t strong = BlockIndex::strongHash(buf.data() + pos, bs);
+            for (std::size_t blk : it->second) {
+                if (matches[blk] < 0 && blockIndex.blocks[blk].strong == strong) {
+                    // Identical blocks (e.g. zero runs) all share one source
+                    matches[blk] = static_cast<std::int64_t>(bufBase + pos);
+                    --remaining;
+                    matched = true;
+                }
+            }
+        }
+
+        if (matched) {
+            pos += bs;
+            haveSum = false;
+            continue;
+        }
+
+        if (pos + bs >= filled)
+            break; // at EOF, nothing left to roll in
+        sum.roll(buf[pos], buf[pos + bs]);
+        ++pos;
+    }
+
+    return true;
+}
+
+bool DeltaPlanner::apply(OutputSink& sink, RangeSet& done) {
+    const std::uint64_t bs = blockIndex.blockSize;
+    const std::uint64_t total = blockIndex.fileLength;
+
+    std::vector<CopyRange> copies;
+    done.clear();
+
+    auto blockSizeAt = [&](std::size_t i) {
+        return std::min<std::uint64_t>(bs, total - i * bs);
+    };
+
+    std::size_t i = 0;
+    while (i < matches.size()) {
+        if (matches[i] < 0) {
+            ++i;
+            continue;
+        }
+
+        // Merge runs that are contiguous on both sides into one copy
+        const std::uint64_t start = i * bs;
+        std::uint64_t len = 0;
+        std::size_t j = i;
+        while (j < matches.size() && matches[j] >= 0
+            && matches[j] == matches[i] + static_cast<std::int64_t>(len)) {
+            len += blockSizeAt(j);
+            ++j;
+        }
+        copies.push_back({ static_cast<std::uint64_t>(matches[i]), start, len });
+        done.add(start, start + len);
+        i = j;
+    }
+
+    if (copies.empty())
+        return true;
+    return sink.copyRanges(basePath, copies);
+}
+
+std::uint64_t DeltaPlanner::matchedBytes() const {
+    std::uint64_t bytes = 0;
+    for (std::size_t i = 0; i < matches.size(); ++i) {
+        if (matches[i] >= 0)
+            bytes += std::min<std::uint64_t>(blockIndex.blockSize, blockIndex.fileLength - i * blockIndex.blockSize);
+    }
+    return bytes;
+}
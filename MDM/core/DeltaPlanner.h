@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "utils.h"
+#include "../io/BlockIndex.h"
+#include "../io/OutputSink.h"
+
+// zsync-style reuse of a previous local version: finds which blocks of the
+// remote file already exist somewhere in the local file, copies them into
+// the output so only the rest has to be downloaded.
+class DeltaPlanner {
+public:
+    explicit DeltaPlanner(const BlockIndex& index);
+
+    bool scan(const std::string& localPath);
+
+    // Copies matched blocks into `sink` and records them in `done`
+    bool apply(OutputSink& sink, RangeSet& done);
+
+    std::uint64_t matchedBytes() const;
+
+private:
+    const BlockIndex& blockIndex;
+    std::string basePath;
+    // Local offset of each remote block, or -1 if it must be downloaded
+    std::vector<std::int64_t> matches;
+};
@@ -0,0 +1,103 @@
+#include "Download.h"
+
+#include "DownloadController.h"
+#include "../io/MemorySink.h"
+
+Download::Download(const DownloadConfig& config)
+    : cfg(config),
+    result(promise.get_future().share()) {
+}
+
+Download::~Download() {
+    cancel();
+    if (runner.joinable())
+        runner.join();
+}
+
+void Download::toMemory(char* buffer, std::size_t capacity) {
+    sinkFactory = [buffer, capacity](std::uint64_t size) {
+        return std::make_unique<MemorySink>(buffer, capacity, size);
+    };
+}
+
+void Download::toMemory(BufferProvider provider) {
+    sinkFactory = [provider = std::move(provider)](std::uint64_t size) {
+        char* buffer = provider(size);
+        return std::make_unique<MemorySink>(buffer, buffer ? static_cast<std::size_t>(size) : 0, size);
+    };
+}
+
+void Download::toCallback(DataCallback onData) {
+    sinkFactory = [onData = std::move(onData)](std::uint64_t) {
+        return std::make_unique<CallbackSink>(onData);
+    };
+}
+
+void Download::toSink(SinkFactory factory) {
+    sinkFactory = std::move(factory);
+}
+
+void Download::onProgress(ProgressCallback cb) {
+    progressCb = std::move(cb);
+}
+
+void Download::onComplete(CompletionCallback cb) {
+    completeCb = std::move(cb);
+}
+
+void Download::onLog(LogCallback cb) {
+    logCb = std::move(cb);
+}
+
+std::shared_future<DownloadResult> Download::start() {
+    if (controller)
+        return result;
+
+    controller = std::make_unique<DownloadController>(cfg);
+    if (sinkFactory)
+        controller->setSinkFactory(sinkFactory);
+    controller->setLogHandler(logCb ? logCb : [](const std::string&) {});
+    controller->setProgressCallback([this](const DownloadProgress& p) {
+        {
+            std::lock_guard<std::mutex> lock(progressMutex);
+            lastProgress = p;
+        }
+        if (progressCb)
+            progressCb(p);
+    });
+
+    runner = std::thread(&Download::run, this);
+    return result;
+}
+
+void Download::run() {
+    DownloadResult res;
+    res.success = controller->start();
+    res.bytes = progress().downloaded;
+    if (!res.success) {
+        res.error = controller->errorMessage();
+        if (res.error.empty())
+            res.error = cancelled.load() ? "cancelled" : "download failed";
+    }
+
+    if (completeCb)
+        completeCb(res);
+    promise.set_value(res);
+}
+
+void Download::cancel() {
+    cancelled.store(true);
+    if (controller)
+        controller->requestStop();
+}
+
+DownloadResult Download::wait() {
+    if (!controller)
+        start();
+    return result.get();
+}
+
+DownloadProgress Download::progress() const {
+    std::lock_guard<std::mutex> lock(progressMutex);
+    return lastProgress;
+}
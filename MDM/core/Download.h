@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <functional>
+
+#include "utils.h"
+#include "../io/OutputSink.h"
+#include "../io/CallbackSink.h"
+
+class DownloadController;
+
+struct DownloadResult {
+    bool success = false;
+    std::uint64_t bytes = 0;
+    std::string error;
+};
+
+// Library entry point: one transfer on its own thread. Pick an output and
+// callbacks, then start(). Callbacks run on internal threads; without onLog
+// nothing is printed.
+//
+//     std::vector<char> weights;
+//     Download dl(cfg);
+//     dl.toMemory([&](std::uint64_t n) { weights.resize(n); return weights.data(); });
+//     auto done = dl.start();
+//     if (!done.get().success) ...
+class Download {
+public:
+    using ProgressCallback = std::function<void(const DownloadProgress&)>;
+    using CompletionCallback = std::function<void(const DownloadResult&)>;
+    using LogCallback = std::function<void(const std::string&)>;
+    using DataCallback = CallbackSink::DataCallback;
+    // Called once the size is known; returns a buffer of at least `size` bytes
+    using BufferProvider = std::function<char*(std::uint64_t size)>;
+    using SinkFactory = std::function<std::unique_ptr<OutputSink>(std::uint64_t size)>;
+
+    explicit Download(const DownloadConfig& config);
+    // Cancels a running transfer and waits for it
+    ~Download();
+
+    Download(const Download&) = delete;
+    Download& operator=(const Download&) = delete;
+
+    // Output, default config.outputPath. Non-file outputs skip resume,
+    // checkpoints and decompression. Call before start().
+    void toMemory(char* buffer, std::size_t capacity);
+    void toMemory(BufferProvider provider);
+    void toCallback(DataCallback onData);
+    void toSink(SinkFactory factory);
+
+    void onProgress(ProgressCallback cb);
+    void onComplete(CompletionCallback cb);
+    void onLog(LogCallback cb);
+
+    std::shared_future<DownloadResult> start();
+    // Aborts in-flight transfers; the result still arrives, unsuccessful
+    void cancel();
+    DownloadResult wait();
+    // Last reported progress (updated once a second)
+    DownloadProgress progress() const;
+
+private:
+    void run();
+
+private:
+    DownloadConfig cfg;
+    SinkFactory sinkFactory;
+    ProgressCallback progressCb;
+    CompletionCallback completeCb;
+    LogCallback logCb;
+
+    std::unique_ptr<DownloadController> controller;
+    std::promise<DownloadResult> promise;
+    std::shared_future<DownloadResult> result;
+    std::thread runner;
+    std::atomic<bool> cancelled{ false };
+
+    mutable std::mutex progressMutex;
+    DownloadProgress lastProgress;
+};
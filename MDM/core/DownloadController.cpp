@@ -5,6 +5,15 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <filesystem>
+
+namespace {
+// Out-of-order data held for the streaming decoder before writers block
+constexpr std::size_t kDecompressBufferLimit = 64 * 1024 * 1024;
+// Write pipeline arena: buffers per worker and their size
+constexpr std::size_t kWriteBufferSize = 256 * 1024;
+constexpr std::size_t kWriteBuffersPerWorker = 4;
+}
 
 DownloadController::DownloadController(const DownloadConfig& config, volatile std::sig_atomic_t* externalStop)
     : cfg(config),
@@ -13,82 +22,136 @@ DownloadController::DownloadController(const DownloadConfig& config, volatile st
 {
 }
 
-bool DownloadController::start() {
-    logger.start();
-    if (!initMetadata())
-        return false;
+void DownloadController::setSinkFactory(SinkFactory factory) {
+    sinkFactory = std::move(factory);
+}
 
-    progress.reset(metadata.fileSize);
+void DownloadController::setProgressCallback(ProgressCallback cb) {
+    progressCallback = std::move(cb);
+}
 
-    // Decide numbers of thread
-    workerCount = cfg.maxThreads;
-    if (workerCount == 0) {
-        std::size_t hw = std::thread::hardware_concurrency();
-        if (hw == 0) hw = 4; // fallback
-        workerCount = std::clamp<std::size_t>(hw * 2, 2, 32);
-    }
+void DownloadController::setLogHandler(std::function<void(const std::string&)> handler) {
+    logger.setHandler(std::move(handler));
+}
 
-    if (!supportsRange) {
-        workerCount = 1;
-    }
+void DownloadController::setSharedResources(const SharedResources& resources) {
+    shared = resources;
+}
 
-    if (!metadata.segments.empty())
-        workerCount = std::min<std::size_t>(workerCount, metadata.segments.size());
-    else
-        workerCount = 1;
+bool DownloadController::start() {
+    planPlacement();
+    logger.setAffinity(loggerCpus);
+    logger.start();
 
-    connectionPool = std::make_unique<ConnectionPool>(cfg.url, workerCount);
+    const auto startTime = std::chrono::steady_clock::now();
 
-    fileWriter = std::make_unique<FileWriter>(cfg.outputPath, metadata.fileSize);
-    if (!fileWriter->open())
-        return false;
+    // Held until the download is recorded, so concurrent requests for the
+    // same URL wait for this one and are then served from the cache
+    if (!cfg.cacheDir.empty() && !sinkFactory && cfg.decompress == CompressionFormat::None
+        && cfg.archiveMembers.empty()) {
+        cache = std::make_unique<DownloadCache>(cfg.cacheDir);
+        if (!cache->lock(cfg.url, stopFlag)) {
+            stop();
+            return false;
+        }
+        if (serveFromCache()) {
+            stop();
+            return true;
+        }
+    }
 
-    segmentQueue = std::make_unique<SegmentQueue>(metadata.segments);
-    threadPool = std::make_unique<ThreadPool>(stopFlag);
+    // The first ranged GET doubles as the metadata request; HEAD is only
+    // the fallback. Archive members need the size before anything is read.
+    if (!cfg.archiveMembers.empty()) {
+        if (!initMetadata() || !planArchive() || !prepare())
+            return false;
+        launch();
+    }
+    else if (cfg.headFirst || !bootstrap()) {
+        if (setupFailed || !initMetadata() || !prepare())
+            return false;
+        launch();
+    }
 
-    spawnWorkers();
+    auto nextProgressLog = std::chrono::steady_clock::now() + std::chrono::seconds(1);
 
-    const auto startTime = std::chrono::steady_clock::now();
-    auto lastProgressLog = startTime;
+    // Woken by worker reports and stop requests; the timeout only drives the
+    // once-a-second progress line. Checking allSegmentsDone() up front ends
+    // downloads with nothing left to fetch (empty, or finished by the
+    // bootstrap request) without a report ever arriving.
+    std::unique_lock<std::mutex> eventLock(eventMutex);
+    for (;;) {
+        eventCv.wait_until(eventLock, nextProgressLog, [&]() {
+            return eventPending || stopFlag.load(std::memory_order_relaxed) || allSegmentsDone();
+        });
+        eventPending = false;
 
-    // Log progress
-    while (!stopFlag.load(std::memory_order_relaxed)) {
         if (externalStopSignal && *externalStopSignal != 0)
             stopFlag.store(true, std::memory_order_relaxed);
 
-        if (allSegmentsDone())
+        publishWatermark();
+
+        if (stopFlag.load(std::memory_order_relaxed) || allSegmentsDone() || segmentQueue->hasFailed())
             break;
 
         auto now = std::chrono::steady_clock::now();
-        if (now - lastProgressLog >= std::chrono::seconds(1)) {
+        if (now >= nextProgressLog) {
+            progress.sample();
+
             const auto downloaded = progress.downloaded();
             const double pct = progress.progress() * 100.0;
+            const double eta = progress.etaSeconds();
 
             std::ostringstream os;
             os << "Progress: "
                 << downloaded << "/" << metadata.fileSize << " bytes ("
-                << std::fixed << std::setprecision(1) << pct << "%)";
+                << std::fixed << std::setprecision(1) << pct << "%), "
+                << std::setprecision(2) << (progress.speedBytesPerSec() * 8.0 / 1'000'000.0)
+                << " Mbps, ETA ";
+            if (eta < 0.0)
+                os << "--";
+            else
+                os << std::setprecision(0) << eta << "s";
+
+            std::size_t active = 0;
+            double slowest = 0.0, fastest = 0.0;
+            for (std::size_t slot = 0; slot < progress.slotCount(); ++slot) {
+                const double rate = progress.connectionBytesPerSec(slot);
+                if (rate <= 0.0)
+                    continue;
+                slowest = active == 0 ? rate : std::min(slowest, rate);
+                fastest = std::max(fastest, rate);
+                ++active;
+            }
+            if (active > 0)
+                os << ", " << active << " connections at "
+                    << std::setprecision(2) << (slowest * 8.0 / 1'000'000.0) << "-"
+                    << (fastest * 8.0 / 1'000'000.0) << " Mbps";
 
             logger.log(os.str());
-            lastProgressLog = now;
+            reportProgress();
+            nextProgressLog = now + std::chrono::seconds(1);
         }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
+    eventLock.unlock();
+
+    // In-flight transfers abort through curl's progress hook and record what
+    // they already wrote; join them before summarizing
+    stopFlag.store(true);
+    if (outputSink && !allSegmentsDone())
+        outputSink->abort();
+    segmentQueue->cancel();
+    threadPool->shutdown();
 
     const auto endTime = std::chrono::steady_clock::now();
     const std::chrono::duration<double> duration = endTime - startTime;
     const double avgSpeed = duration.count() > 0
-        ? static_cast<double>(progress.downloaded()) / duration.count()
+        ? static_cast<double>(progress.downloaded() - reusedBytes) / duration.count()
         : 0.0;
 
     const bool success = allSegmentsDone();
     {
-        std::size_t doneSegments = 0;
-        for (const auto& seg : metadata.segments) {
-            if (seg.state == SegmentState::Done)
-                ++doneSegments;
-        }
+        const std::size_t doneSegments = segmentQueue->doneCount();
 
         std::ostringstream conclusion;
         conclusion << "Download "
@@ -97,7 +160,29 @@ bool DownloadController::start() {
             << duration.count() << "s, avg speed "
             << std::setprecision(2) << (avgSpeed * 8.0 / 1'000'000.0)
             << " Mbps, threads " << workerCount
-            << ", segments " << doneSegments << "/" << metadata.segments.size();
+            << ", segments " << doneSegments << "/" << segmentQueue->size();
+
+        if (writePipeline) {
+            const auto ws = writePipeline->stats();
+            conclusion << ", write stalls " << ws.arenaWaits
+                << " (" << std::setprecision(2) << ws.arenaWaitSeconds << "s)"
+                << ", peak buffers " << ws.peakBuffersInUse << "/" << ws.bufferCount;
+        }
+
+        if (cfg.bindInterfaces.size() > 1) {
+            for (const auto& path : connectionPool->interfaceStats()) {
+                conclusion << ", " << path.name << " " << path.bytes << " bytes ("
+                    << std::setprecision(2) << (path.bytesPerSec * 8.0 / 1'000'000.0) << " Mbps/conn";
+                if (path.failures > 0)
+                    conclusion << ", " << path.failures << " failed";
+                conclusion << ")";
+            }
+        }
+
+        if (checkpointer && cfg.durability != DurabilityMode::None) {
+            conclusion << ", checkpoints " << checkpointer->commitCount()
+                << " (sync " << std::setprecision(2) << checkpointer->syncSeconds() << "s)";
+        }
 
         if (encounteredError.load(std::memory_order_relaxed)) {
             std::string errCopy;
@@ -115,66 +200,587 @@ bool DownloadController::start() {
         }
 
         logger.log(conclusion.str());
+        logConnections();
     }
+    reportProgress();
 
     stop();
-    return allSegmentsDone();
+    return allSegmentsDone() && sinkClosedOk;
 }
 
-bool DownloadController::allSegmentsDone() const {
-    for (const auto& seg : metadata.segments) {
-        if (seg.state != SegmentState::Done)
-            return false;
+void DownloadController::reportProgress() {
+    if (!progressCallback)
+        return;
+
+    DownloadProgress p;
+    p.downloaded = progress.downloaded();
+    p.total = metadata.fileSize;
+    p.bytesPerSec = progress.speedBytesPerSec();
+    p.etaSeconds = progress.etaSeconds();
+    progressCallback(p);
+}
+
+void DownloadController::logConnections() {
+    // Small rcv space with a clean RTT points at us (window, buffers);
+    // retransmits, losses and RTT variance point at the network
+    std::size_t n = 0;
+    for (const auto& conn : connectionPool->connectionSamples()) {
+        ++n;
+        if (!conn.tcp.valid)
+            continue;
+        std::ostringstream os;
+        os << "Connection " << n;
+        if (!conn.interfaceName.empty())
+            os << " [" << conn.interfaceName << "]";
+        os << ": " << conn.bytes << " bytes, rtt " << std::fixed << std::setprecision(2)
+            << conn.tcp.rttMs << "ms (var " << conn.tcp.rttVarMs << "ms, rcv " << conn.tcp.rcvRttMs << "ms)"
+            << ", rcv space " << conn.tcp.rcvSpace
+            << ", cwnd " << conn.tcp.cwnd << "x" << conn.tcp.mss
+            << ", retrans " << conn.tcp.retransmits
+            << ", lost " << conn.tcp.lost;
+        logger.log(os.str());
     }
-    return true;
 }
 
+void DownloadController::publishWatermark() {
+    if (watermark && segmentQueue)
+        watermark->publish(segmentQueue->contiguousPrefix(), metadata.fileSize);
+}
+
+void DownloadController::fail(const std::string& msg) {
+    logger.log(msg);
+    encounteredError.store(true, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(errorMutex);
+    lastError = msg;
+}
+
+std::string DownloadController::errorMessage() {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    return lastError;
+}
+
+bool DownloadController::allSegmentsDone() const {
+    return segmentQueue && segmentQueue->allDone();
+}
+
+
+void DownloadController::requestStop() {
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        stopFlag.store(true);
+    }
+    eventCv.notify_all();
+}
 
 void DownloadController::stop() {
     stopFlag.store(true);
+
+    // A sink with bounded buffering may hold writers that wait for data
+    // which will never arrive once we stop early
+    if (outputSink && !allSegmentsDone())
+        outputSink->abort();
+
+    if (segmentQueue)
+        segmentQueue->cancel();
     if (threadPool)
         threadPool->shutdown();
 
-    if (fileWriter)
-        fileWriter->close();
+    // Workers are gone, so this checkpoint is exactly what is on disk
+    const bool complete = allSegmentsDone();
+    if (checkpointer) {
+        checkpointer->stop(!complete);
+        checkpointer.reset();
+    }
+
+    if (outputSink) {
+        // Data must be durable before the resume record goes away, or a
+        // crash right after completion leaves a bad file and no way to tell
+        bool synced = true;
+        if (complete && cfg.durability != DurabilityMode::None)
+            synced = outputSink->sync();
+        sinkClosedOk = outputSink->close() && synced;
+        if (complete && sinkClosedOk && metadataStore)
+            metadataStore->remove();
+        if (complete && sinkClosedOk && watermark)
+            watermark->remove();
+        else
+            publishWatermark();
+        if (complete && sinkClosedOk && cache
+            && cache->insert(cfg.url, metadata.etag, remoteDigest, cfg.outputPath))
+            logger.log("Cached " + cfg.url);
+        if (!sinkClosedOk && allSegmentsDone())
+            logger.log("Output finalization failed for " + cfg.outputPath);
+        writePipeline = nullptr;
+        outputSink.reset();
+    }
 
+    cache.reset();
+    watermark.reset();
     logger.stop();
 }
 
+void DownloadController::planPlacement() {
+    ThreadPlacement::CpuSet nodeCpus;
+    if (!cfg.nicInterface.empty()) {
+        const int node = ThreadPlacement::nicNumaNode(cfg.nicInterface);
+        nodeCpus = ThreadPlacement::cpusOfNode(node);
+    }
+
+    // The lists were validated by the argument parser
+    workerCpus = nodeCpus;
+    writerCpus = nodeCpus;
+    if (!cfg.workerCpus.empty())
+        ThreadPlacement::parseCpuList(cfg.workerCpus, workerCpus);
+    if (!cfg.writerCpus.empty())
+        ThreadPlacement::parseCpuList(cfg.writerCpus, writerCpus);
+    ThreadPlacement::parseCpuList(cfg.loggerCpus, loggerCpus);
+}
+
+std::unique_ptr<OutputSink> DownloadController::createSink() {
+    if (sinkFactory)
+        return sinkFactory(metadata.fileSize);
+
+    if (!cfg.archiveMembers.empty())
+        return std::make_unique<ArchiveSink>(cfg.outputPath, archiveMembers, kDecompressBufferLimit);
+
+    if (cfg.decompress == CompressionFormat::None) {
+        auto file = std::make_unique<FileWriter>(cfg.outputPath, metadata.fileSize, resumed);
+        file->setEarlyWriteback(cfg.durability != DurabilityMode::None);
+        file->setDropCache(cfg.dropPageCache);
+        if (cfg.writerThreads == 0)
+            return file;
+
+        // +1 producer for the controller thread, which streams the first
+        // segment from the probe response
+        auto piped = std::make_unique<PipelinedSink>(std::move(file),
+            workerCount + 1,
+            cfg.writerThreads,
+            kWriteBufferSize,
+            std::max<std::size_t>(16, workerCount * kWriteBuffersPerWorker));
+        piped->setWriterAffinity(writerCpus);
+        // Arena pages land on the node the NIC and workers are on
+        ThreadPlacement::runOn(workerCpus, [&]() { piped->prefaultBuffers(); });
+        writePipeline = piped.get();
+        return piped;
+    }
+
+    if (!Decompressor::isSupported(cfg.decompress)) {
+        logger.log("Compression format not supported by this build");
+        return nullptr;
+    }
+
+    std::unique_ptr<OutputSink> compressedCopy;
+    if (!cfg.keepCompressedPath.empty())
+        compressedCopy = std::make_unique<FileWriter>(cfg.keepCompressedPath, metadata.fileSize);
+
+    return std::make_unique<DecompressSink>(cfg.outputPath,
+        cfg.decompress,
+        cfg.extractTar,
+        std::move(compressedCopy),
+        kDecompressBufferLimit);
+}
+
+bool DownloadController::loadDeltaIndex(BlockIndex& index) {
+    const std::string& src = cfg.deltaIndex;
+    if (src.rfind("http://", 0) != 0 && src.rfind("https://", 0) != 0)
+        return index.load(src);
+
+    std::string text;
+    HttpClient client(src);
+    const bool ok = client.get([&](const char* data, std::size_t size) {
+        text.append(data, size);
+        return true;
+        });
+    return ok && index.parse(text);
+}
+
+void DownloadController::applyDelta(const std::string& basePath) {
+    BlockIndex index;
+    if (!loadDeltaIndex(index)) {
+        logger.log("Delta: cannot load block index " + cfg.deltaIndex + ", downloading everything");
+        return;
+    }
+    if (index.fileLength != metadata.fileSize) {
+        logger.log("Delta: block index does not describe this file, downloading everything");
+        return;
+    }
+
+    DeltaPlanner planner(index);
+    if (!planner.scan(basePath)) {
+        logger.log("Delta: cannot read " + cfg.deltaBasePath + ", downloading everything");
+        return;
+    }
+
+    RangeSet reused;
+    if (!planner.apply(*outputSink, reused)) {
+        logger.log("Delta: copying local blocks failed, downloading everything");
+        return;
+    }
+
+    metadata.done = std::move(reused);
+    reusedBytes = metadata.done.bytes();
+    metadata.completedBytes = reusedBytes;
+    progress.add(reusedBytes);
+
+    std::ostringstream os;
+    os << "Delta: reused " << reusedBytes << "/" << metadata.fileSize
+        << " bytes from " << cfg.deltaBasePath;
+    logger.log(os.str());
+}
+
+bool DownloadController::checkFreeSpace() {
+    std::uint64_t available = 0;
+    if (!FileWriter::freeSpace(cfg.outputPath, available))
+        return true; // unknown, let preallocation decide
+
+    // An existing output is replaced, its blocks come back
+    std::error_code ec;
+    const std::uint64_t existing = std::filesystem::exists(cfg.outputPath, ec)
+        ? std::filesystem::file_size(cfg.outputPath, ec) : 0;
+
+    if (available + existing >= metadata.fileSize)
+        return true;
+
+    std::ostringstream os;
+    os << "Not enough free space for " << cfg.outputPath << ": need "
+        << metadata.fileSize << " bytes, " << (available + existing) << " available";
+    fail(os.str());
+    return false;
+}
+
+bool DownloadController::tryResume() {
+    // A decoded stream cannot be resumed from the middle, and caller sinks
+    // keep no state between runs
+    if (sinkFactory || cfg.decompress != CompressionFormat::None || !supportsRange
+        || !cfg.archiveMembers.empty())
+        return false;
+
+    metadataStore = std::make_unique<MetadataStore>(cfg.outputPath + ".mdm");
+    if (!metadataStore->exists())
+        return false;
+
+    std::error_code ec;
+    if (std::filesystem::file_size(cfg.outputPath, ec) != metadata.fileSize || ec) {
+        logger.log("Ignoring resume data, " + cfg.outputPath + " is missing or truncated");
+        return false;
+    }
+
+    DownloadMetadata saved;
+    if (!metadataStore->load(saved)
+        || saved.url != metadata.url
+        || !metadataStore->validate(saved, metadata.etag, metadata.fileSize)) {
+        logger.log("Ignoring stale resume data for " + cfg.outputPath);
+        return false;
+    }
+
+    // Only what a checkpoint recorded as done is trusted
+    metadata.done = std::move(saved.done);
+    metadata.completedBytes = metadata.done.bytes();
+    return true;
+}
+
+bool DownloadController::prepare() {
+    resumed = tryResume();
+
+    // Decide numbers of thread
+    workerCount = cfg.maxThreads;
+    if (workerCount == 0) {
+        // Only the CPUs workers may run on count, e.g. the NIC's node
+        std::size_t hw = workerCpus.empty() ? std::thread::hardware_concurrency() : workerCpus.size();
+        if (hw == 0) hw = 4; // fallback
+        workerCount = std::clamp<std::size_t>(hw * 2, 2, 32);
+    }
+
+    if (!supportsRange) {
+        workerCount = 1;
+    }
+
+    const std::uint64_t maxSegments = metadata.fileSize == 0
+        ? 1
+        : (metadata.fileSize + cfg.segmentSize - 1) / cfg.segmentSize;
+    workerCount = static_cast<std::size_t>(std::min<std::uint64_t>(workerCount, maxSegments));
+    if (workerCount == 0)
+        workerCount = 1;
+
+    progress.reset(metadata.fileSize, workerCount + 1);
+
+    connectionPool = std::make_unique<ConnectionPool>(cfg.url, workerCount, cfg.bindInterfaces);
+    connectionPool->setZeroCopy(cfg.zeroCopy);
+    connectionPool->setSocketOptions(&cfg.socket);
+    if (shared.curlShare)
+        connectionPool->setShare(shared.curlShare->handle());
+
+    if (!sinkFactory && cfg.decompress == CompressionFormat::None && cfg.archiveMembers.empty()
+        && !resumed && !checkFreeSpace())
+        return false;
+
+    outputSink = createSink();
+    // The previous version is often the output itself; opening the sink
+    // truncates it, so move it aside first
+    const bool useDelta = !resumed && cfg.archiveMembers.empty() && !cfg.deltaBasePath.empty() && supportsRange;
+    std::string deltaBase = cfg.deltaBasePath;
+    bool baseMoved = false;
+    if (useDelta && !sinkFactory) {
+        std::error_code ec;
+        if (std::filesystem::equivalent(cfg.deltaBasePath, cfg.outputPath, ec)) {
+            deltaBase = cfg.outputPath + ".mdmbase";
+            std::filesystem::rename(cfg.outputPath, deltaBase, ec);
+            baseMoved = !ec;
+            if (ec)
+                deltaBase.clear();
+        }
+    }
+
+    if (!outputSink || !outputSink->open()) {
+        if (baseMoved) {
+            std::error_code ec;
+            std::filesystem::rename(deltaBase, cfg.outputPath, ec);
+        }
+        fail(sinkFactory ? std::string("Cannot open output sink") : "Cannot open output " + cfg.outputPath);
+        return false;
+    }
+
+    if (resumed) {
+        progress.add(metadata.completedBytes);
+        std::ostringstream os;
+        os << "Resuming: " << metadata.completedBytes << "/" << metadata.fileSize << " bytes already present";
+        logger.log(os.str());
+    }
+    else if (!cfg.archiveMembers.empty()) {
+        // Everything but the members' data was planned as done
+        reusedBytes = metadata.done.bytes();
+        progress.add(reusedBytes);
+    }
+    else if (useDelta) {
+        if (deltaBase.empty())
+            logger.log("Delta: cannot move " + cfg.outputPath + " aside, downloading everything");
+        else
+            applyDelta(deltaBase);
+        if (baseMoved) {
+            std::error_code ec;
+            std::filesystem::remove(deltaBase, ec);
+        }
+    }
+
+    segmentQueue = std::make_unique<SegmentQueue>(metadata.done, metadata.fileSize, cfg.segmentSize);
+    if (cfg.adaptiveSegments && supportsRange) {
+        segmentSizer = std::make_unique<SegmentSizer>(workerCount + 1,
+            cfg.segmentSize, cfg.segmentSize, cfg.maxSegmentSize);
+        segmentQueue->setSizer(segmentSizer.get(), workerCount);
+    }
+    segmentQueue->setBatching(supportsRange);
+
+    // The prefix only means something for a plain output file
+    if (cfg.sequentialWindow > 0) {
+        segmentQueue->setWindow(cfg.sequentialWindow);
+        if (!sinkFactory && cfg.decompress == CompressionFormat::None && cfg.archiveMembers.empty()) {
+            watermark = std::make_unique<WatermarkFile>(cfg.outputPath + ".prefix");
+            publishWatermark();
+        }
+    }
+    return true;
+}
+
+void DownloadController::launch() {
+    threadPool = std::make_unique<ThreadPool>(stopFlag);
+    threadPool->setAffinity(workerCpus);
+
+    // Workers report to the checkpointer, so it must exist before they run
+    if (metadataStore) {
+        checkpointer = std::make_unique<Checkpointer>(cfg.durability,
+            std::chrono::milliseconds(cfg.checkpointIntervalMs),
+            *outputSink,
+            *segmentQueue,
+            *metadataStore,
+            metadata);
+        checkpointer->start();
+    }
+
+    spawnWorkers();
+}
+
+bool DownloadController::serveFromCache() {
+    CacheEntry entry;
+    if (!cache->lookup(cfg.url, entry))
+        return false;
+
+    HttpClient client(cfg.url);
+    client.setAbortFlag(&stopFlag);
+    HttpHeadResult head;
+    if (!client.head(head, entry.etag))
+        return false;
+
+    // 304, or a server that ignores If-None-Match but kept the ETag. Failing
+    // that, the new version may already be cached under its digest.
+    const bool unchanged = head.status == 304
+        || (head.status == 200 && !entry.etag.empty() && head.etag == entry.etag);
+    if (!unchanged && (head.status != 200 || !cache->findByDigest(head.digest, entry)))
+        return false;
+
+    if (!DownloadCache::materialize(entry.objectPath, cfg.outputPath)) {
+        logger.log("Cache: cannot link " + entry.objectPath + " to " + cfg.outputPath);
+        return false;
+    }
+
+    // A cached copy supersedes any interrupted download of the same output
+    MetadataStore(cfg.outputPath + ".mdm").remove();
+
+    if (!unchanged)
+        cache->insert(cfg.url, head.etag, head.digest, cfg.outputPath);
+
+    std::ostringstream os;
+    os << "Served " << entry.size << " bytes from cache " << cfg.cacheDir;
+    logger.log(os.str());
+    return true;
+}
+
+bool DownloadController::bootstrap() {
+    auto client = std::make_unique<HttpClient>(cfg.url);
+    client->setAbortFlag(&stopFlag);
+    if (!cfg.bindInterfaces.empty())
+        client->setInterface(cfg.bindInterfaces.front());
+    client->setSocketOptions(&cfg.socket);
+    if (shared.curlShare)
+        client->setShare(shared.curlShare->handle());
+
+    // The first request counts against a shared connection budget as well
+    if (shared.connections && !shared.connections->acquire(shared.priority, stopFlag))
+        return false;
+
+    HttpHeadResult head;
+    std::unique_ptr<DownloadWorker> worker;
+    std::optional<Segment> first;
+    WorkerReport rep{};
+    bool decided = false;
+
+    // Headers are complete once the body starts: plan the download and
+    // start the workers, then keep streaming the first segment from here
+    const bool ok = client->probe(cfg.segmentSize, head, [&](const char* data, std::size_t size) {
+        if (!decided) {
+            decided = true;
+            std::uint64_t firstSize = 0;
+            if (!adoptHeaders(head, firstSize))
+                return false;
+            if (!prepare()) {
+                setupFailed = true;
+                return false;
+            }
+
+            // Already on disk (resume, delta): drop this response
+            first = segmentQueue->claim(0, firstSize);
+            if (first) {
+                rep.segmentIndex = first->index;
+                worker = std::make_unique<DownloadWorker>(*segmentQueue,
+                    *outputSink,
+                    *connectionPool,
+                    progress,
+                    0,
+                    [this](const WorkerReport& r) {
+                        onWorkerReport(r);
+                    },
+                    stopFlag);
+                worker->setShared(shared);
+            }
+            launch();
+        }
+        return first && worker->receive(*first, rep, data, size);
+    });
+    if (shared.connections)
+        shared.connections->release();
+
+    if (!threadPool)
+        return false;
+
+    if (first)
+        worker->finish(*first, *client, ok, rep);
+    connectionPool->release(std::move(client));
+
+    // The pool's workers may have run dry before the first segment went back
+    // to the queue, so see it through here
+    if (first && !rep.success && !stopFlag.load(std::memory_order_relaxed))
+        worker->run();
+
+    return true;
+}
+
+bool DownloadController::adoptHeaders(const HttpHeadResult& head, std::uint64_t& firstSize) {
+    if (head.status == 206) {
+        if (!head.hasContentRange || head.rangeFirst != 0 || head.instanceLength == 0)
+            return false;
+        supportsRange = true;
+        metadata.fileSize = head.instanceLength;
+        firstSize = head.rangeLast + 1;
+    }
+    else if (head.status == 200) {
+        // Range ignored, this response is the whole file
+        if (head.contentLength == 0)
+            return false;
+        supportsRange = false;
+        metadata.fileSize = head.contentLength;
+        firstSize = head.contentLength;
+    }
+    else {
+        return false;
+    }
+
+    metadata.url = cfg.url;
+    metadata.etag = head.etag;
+    metadata.completedBytes = 0;
+    metadata.done.clear();
+    remoteDigest = head.digest;
+    return true;
+}
+
 bool DownloadController::initMetadata() {
     HttpClient client(cfg.url);
     HttpHeadResult head{};
 
-    if (!client.head(head))
+    if (!client.head(head)) {
+        fail("Cannot reach " + cfg.url);
         return false;
+    }
     supportsRange = head.acceptRanges;
 
     metadata.url = cfg.url;
     metadata.etag = head.etag;
+    remoteDigest = head.digest;
     metadata.fileSize = head.contentLength;
     metadata.completedBytes = 0;
+    metadata.done.clear();
 
-    metadata.segments.clear();
-
-    std::uint64_t offset = 0;
-    std::uint64_t index = 0;
+    // Segments are planned lazily in SegmentQueue
+    return true;
+}
 
-    while (offset < metadata.fileSize) {
-        std::uint64_t size = std::min<std::uint64_t>(
-            cfg.segmentSize,
-            metadata.fileSize - offset
-        );
+bool DownloadController::planArchive() {
+    if (!supportsRange) {
+        fail("Server does not support ranges, cannot read archive members of " + cfg.url);
+        return false;
+    }
 
-        metadata.segments.push_back({
-            index++,
-            offset,
-            size,
-            SegmentState::Pending
-            });
+    HttpClient client(cfg.url);
+    client.setAbortFlag(&stopFlag);
+    ArchivePlanner planner(client, metadata.fileSize);
+    if (!planner.plan(cfg.archiveMembers, cfg.archiveTar)) {
+        fail("Cannot read archive index: " + planner.error());
+        return false;
+    }
 
-        offset += size;
+    const auto missing = planner.missing();
+    if (!missing.empty()) {
+        fail("Not in archive: " + missing.front());
+        return false;
     }
 
+    archiveMembers = planner.members();
+    metadata.done = planner.unwanted();
+    metadata.completedBytes = metadata.done.bytes();
+
+    std::ostringstream os;
+    os << "Archive: " << archiveMembers.size() << " members, "
+        << (metadata.fileSize - metadata.completedBytes) << "/" << metadata.fileSize
+        << " bytes to fetch (index " << planner.metadataBytes() << " bytes)";
+    logger.log(os.str());
     return true;
 }
 
@@ -183,13 +789,16 @@ void DownloadController::spawnWorkers() {
 
         DownloadWorker worker(
             *segmentQueue,
-            *fileWriter,
+            *outputSink,
             *connectionPool,
+            progress,
+            nextWorkerSlot.fetch_add(1, std::memory_order_relaxed),
             [this](const WorkerReport& rep) {
                 onWorkerReport(rep);
             },
             stopFlag
         );
+        worker.setShared(shared);
 
         worker.run();
         };
@@ -199,15 +808,18 @@ void DownloadController::spawnWorkers() {
 
 
 void DownloadController::onWorkerReport(const WorkerReport& report) {
+    if (report.bytesDownloaded > 0) {
+        std::lock_guard<std::mutex> lock(metadataMutex);
+        metadata.completedBytes += report.bytesDownloaded;
+    }
+
+    if (report.bytesDownloaded > 0 && checkpointer)
+        checkpointer->onSegmentDone();
+
     if (report.success) {
-        {
-            std::lock_guard<std::mutex> lock(metadataMutex);
-            metadata.completedBytes += report.bytesDownloaded;
-        }
-        progress.add(report.bytesDownloaded);
         //logger.log("Segment " + std::to_string(report.segmentIndex) + " done");
     }
-    else {
+    else if (!stopFlag.load(std::memory_order_relaxed)) {
         encounteredError.store(true, std::memory_order_relaxed);
         {
             std::lock_guard<std::mutex> lock(errorMutex);
@@ -215,5 +827,10 @@ void DownloadController::onWorkerReport(const WorkerReport& report) {
         }
         //logger.log("Segment " + std::to_string(report.segmentIndex) + " failed: " + report.error);
     }
-}
 
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        eventPending = true;
+    }
+    eventCv.notify_one();
+}
@@ -1,17 +1,35 @@
-#pragma once
+﻿#pragma once
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <cstddef>
 #include <csignal>
 #include <chrono>
+#include <optional>
+#include <functional>
 
 #include "utils.h"
 #include "SegmentQueue.h"
+#include "SegmentSizer.h"
+#include "DeltaPlanner.h"
+#include "ArchivePlanner.h"
+#include "ThreadPlacement.h"
+#include "Checkpointer.h"
 #include "ThreadPool.h"
+#include "ConnectionBudget.h"
+#include "RateLimiter.h"
 #include "DownloadWorker.h"
 #include "../io/FileWriter.h"
+#include "../io/DecompressSink.h"
+#include "../io/PipelinedSink.h"
+#include "../io/MetadataStore.h"
+#include "../io/DownloadCache.h"
+#include "../io/ArchiveSink.h"
+#include "../io/WatermarkFile.h"
+#include "../io/OutputSink.h"
 #include "../net/HttpClient.h"
+#include "../net/CurlShare.h"
 #include "../monitor/ProgressTracker.h"
 #include "../monitor/Logger.h"
 
@@ -19,24 +37,68 @@ class DownloadController {
 public:
     explicit DownloadController(const DownloadConfig& config, volatile std::sig_atomic_t* externalStop = nullptr);
 
+    using SinkFactory = std::function<std::unique_ptr<OutputSink>(std::uint64_t fileSize)>;
+    using ProgressCallback = std::function<void(const DownloadProgress&)>;
+
+    // Hooks for embedding; all must be set before start(). A sink factory
+    // replaces the output file (no resume, checkpoints or decompression);
+    // the progress callback runs on the start() thread once a second and
+    // when the download ends.
+    void setSinkFactory(SinkFactory factory);
+    void setProgressCallback(ProgressCallback cb);
+    void setLogHandler(std::function<void(const std::string&)> handler);
+    // Budgets and caches shared with other downloads in this process
+    void setSharedResources(const SharedResources& resources);
+
     bool start();
     void stop();
+    // Safe from any thread: aborts in-flight transfers and wakes start()
+    void requestStop();
+    std::string errorMessage();
 
 private:
     void onWorkerReport(const WorkerReport& report);
+    bool serveFromCache();
+    bool bootstrap();
+    bool adoptHeaders(const HttpHeadResult& head, std::uint64_t& firstSize);
     bool initMetadata();
+    bool planArchive();
+    bool prepare();
+    void launch();
+    bool tryResume();
+    bool checkFreeSpace();
+    void planPlacement();
+    std::unique_ptr<OutputSink> createSink();
+    bool loadDeltaIndex(BlockIndex& index);
+    void applyDelta(const std::string& basePath);
     void spawnWorkers();
     bool allSegmentsDone() const;
+    void fail(const std::string& msg);
+    void reportProgress();
+    void publishWatermark();
+    void logConnections();
 private:
     const DownloadConfig& cfg;
     volatile std::sig_atomic_t* externalStopSignal{ nullptr };
 
     std::atomic<bool> stopFlag{ false };
+    std::mutex eventMutex;
+    std::condition_variable eventCv;
+    bool eventPending{ false };
 
-    std::unique_ptr<FileWriter> fileWriter;
+    std::unique_ptr<OutputSink> outputSink;
+    PipelinedSink* writePipeline{ nullptr };
     std::unique_ptr<SegmentQueue> segmentQueue;
+    std::unique_ptr<SegmentSizer> segmentSizer;
     std::unique_ptr<ThreadPool> threadPool;
     std::unique_ptr<ConnectionPool> connectionPool;
+    std::unique_ptr<MetadataStore> metadataStore;
+    std::unique_ptr<Checkpointer> checkpointer;
+    std::unique_ptr<DownloadCache> cache;
+    std::unique_ptr<WatermarkFile> watermark;
+    SinkFactory sinkFactory;
+    ProgressCallback progressCallback;
+    SharedResources shared;
 
     ProgressTracker progress;
     Logger logger;
@@ -47,5 +109,16 @@ private:
     std::mutex errorMutex;
     std::string lastError;
     bool supportsRange{ false };
+    bool resumed{ false };
+    bool setupFailed{ false };
+    bool sinkClosedOk{ true };
+    std::uint64_t reusedBytes{ 0 };
+    std::string remoteDigest;
+    std::vector<ArchiveMember> archiveMembers;
     std::size_t workerCount{ 0 };
+    ThreadPlacement::CpuSet workerCpus;
+    ThreadPlacement::CpuSet writerCpus;
+    ThreadPlacement::CpuSet loggerCpus;
+    // Slot 0 belongs to the bootstrap worker on the controller thread
+    std::atomic<std::size_t> nextWorkerSlot{ 1 };
 };
@@ -0,0 +1,262 @@
+#include "DownloadDaemon.h"
+#include "../cli/ArgumentParser.h"
+
+#include <chrono>
+#include <climits>
+#include <exception>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+constexpr auto kTick = std::chrono::milliseconds(200);
+}
+
+DownloadDaemon::DownloadDaemon(const Options& options)
+    : opts(options),
+    budget(options.connections),
+    bandwidth(options.bytesPerSec),
+    control(options.socketPath) {
+}
+
+DownloadDaemon::~DownloadDaemon() {
+    for (auto& entry : jobs) {
+        if (entry.second->thread.joinable())
+            entry.second->thread.join();
+    }
+}
+
+bool DownloadDaemon::run(volatile std::sig_atomic_t* externalStop) {
+    if (!control.listen()) {
+        log("Cannot listen on " + opts.socketPath);
+        return false;
+    }
+
+    std::ostringstream os;
+    os << "Listening on " << opts.socketPath << ", " << budget.capacity() << " connections";
+    if (opts.bytesPerSec > 0)
+        os << ", " << std::fixed << std::setprecision(2) << (opts.bytesPerSec * 8.0 / 1'000'000.0) << " Mbps";
+    log(os.str());
+
+    std::thread server([this]() {
+        control.serve([this](const std::string& line) { return handle(line); }, stopFlag);
+    });
+
+    while (!stopFlag.load(std::memory_order_relaxed)) {
+        if (externalStop && *externalStop != 0)
+            stopFlag.store(true);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            schedule();
+        }
+        std::this_thread::sleep_for(kTick);
+    }
+    server.join();
+
+    // Stopped jobs keep their .mdm files and resume on resubmission
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& entry : jobs) {
+        Job& job = *entry.second;
+        if (job.state == JobState::Running)
+            job.controller->requestStop();
+    }
+    for (auto& entry : jobs) {
+        Job& job = *entry.second;
+        if (job.thread.joinable())
+            job.thread.join();
+    }
+    log("Daemon stopped");
+    return true;
+}
+
+std::string DownloadDaemon::handle(const std::string& line) {
+    std::istringstream in(line);
+    std::string command;
+    in >> command;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (command == "add") {
+        std::string rest;
+        std::getline(in, rest);
+        return add(rest);
+    }
+    if (command == "list")
+        return list();
+    if (command == "cancel") {
+        std::uint64_t id = 0;
+        if (!(in >> id))
+            return "error usage: cancel <id>";
+        return cancel(id);
+    }
+    if (command == "shutdown") {
+        stopFlag.store(true);
+        return "ok";
+    }
+    return "error unknown command " + command;
+}
+
+std::string DownloadDaemon::add(const std::string& args) {
+    std::istringstream in(args);
+    int priority = 0;
+    if (!(in >> priority))
+        return "error usage: add <priority> <url> [options]";
+
+    // Same options as the command line; no quoting, paths are relative to
+    // the daemon's working directory
+    std::vector<std::string> words{ "mdm" };
+    for (std::string w; in >> w;)
+        words.push_back(w);
+    std::vector<char*> argv;
+    for (auto& w : words)
+        argv.push_back(w.data());
+
+    auto job = std::make_unique<Job>();
+    ArgumentParser parser;
+    bool parsed = false;
+    try {
+        parsed = parser.parse(static_cast<int>(argv.size()), argv.data(), job->config);
+    }
+    catch (const std::exception&) {
+        // A bad job must never take the queue down with it
+        parsed = false;
+    }
+    if (!parsed || !parser.makeIndexPath.empty() || !parser.daemonSocket.empty() || !parser.controlSocket.empty())
+        return "error bad download options";
+
+    job->id = nextId++;
+    job->priority = priority;
+    const std::uint64_t id = job->id;
+    log("Job " + std::to_string(id) + " queued: " + job->config.url);
+    jobs.emplace(id, std::move(job));
+
+    schedule();
+    return "ok " + std::to_string(id);
+}
+
+std::string DownloadDaemon::list() {
+    if (jobs.empty())
+        return "no jobs";
+
+    std::ostringstream os;
+    bool first = true;
+    for (auto& entry : jobs) {
+        Job& job = *entry.second;
+        DownloadProgress p;
+        {
+            std::lock_guard<std::mutex> lock(job.progressMutex);
+            p = job.progress;
+        }
+        if (!first)
+            os << "\n";
+        first = false;
+        os << job.id << " " << stateName(job.state) << " priority " << job.priority
+            << " " << p.downloaded << "/" << p.total
+            << " " << std::fixed << std::setprecision(2) << (p.bytesPerSec * 8.0 / 1'000'000.0) << "Mbps "
+            << job.config.url;
+        if (!job.error.empty())
+            os << " (" << job.error << ")";
+    }
+    return os.str();
+}
+
+std::string DownloadDaemon::cancel(std::uint64_t id) {
+    auto it = jobs.find(id);
+    if (it == jobs.end())
+        return "error unknown job " + std::to_string(id);
+
+    Job& job = *it->second;
+    if (job.state == JobState::Queued) {
+        job.state = JobState::Cancelled;
+    }
+    else if (job.state == JobState::Running) {
+        job.cancelRequested = true;
+        job.controller->requestStop();
+    }
+    return "ok";
+}
+
+void DownloadDaemon::schedule() {
+    // Reap finished jobs
+    for (auto& entry : jobs) {
+        Job& job = *entry.second;
+        if (job.state != JobState::Running || !job.finished.load(std::memory_order_acquire))
+            continue;
+        job.thread.join();
+        if (job.succeeded)
+            job.state = JobState::Completed;
+        else
+            job.state = job.cancelRequested ? JobState::Cancelled : JobState::Failed;
+        job.controller.reset();
+        log("Job " + std::to_string(job.id) + " " + stateName(job.state)
+            + (job.error.empty() ? std::string() : ": " + job.error));
+    }
+
+    if (stopFlag.load(std::memory_order_relaxed))
+        return;
+
+    for (;;) {
+        Job* next = nullptr;
+        std::size_t running = 0;
+        int lowestRunning = INT_MAX;
+        for (auto& entry : jobs) {
+            Job& job = *entry.second;
+            if (job.state == JobState::Running) {
+                ++running;
+                lowestRunning = std::min(lowestRunning, job.priority);
+            }
+            else if (job.state == JobState::Queued && (!next || job.priority > next->priority)) {
+                next = &job;
+            }
+        }
+
+        if (!next || (running >= opts.maxActive && next->priority <= lowestRunning))
+            return;
+        startJob(*next);
+    }
+}
+
+void DownloadDaemon::startJob(Job& job) {
+    job.state = JobState::Running;
+    job.controller = std::make_unique<DownloadController>(job.config);
+
+    SharedResources shared;
+    shared.connections = &budget;
+    shared.bandwidth = &bandwidth;
+    shared.curlShare = &curlShare;
+    shared.priority = job.priority;
+    job.controller->setSharedResources(shared);
+
+    const std::string prefix = "[job " + std::to_string(job.id) + "] ";
+    job.controller->setLogHandler([this, prefix](const std::string& line) {
+        log(prefix + line);
+    });
+    job.controller->setProgressCallback([&job](const DownloadProgress& p) {
+        std::lock_guard<std::mutex> lock(job.progressMutex);
+        job.progress = p;
+    });
+
+    log("Job " + std::to_string(job.id) + " started, priority " + std::to_string(job.priority));
+    job.thread = std::thread([&job]() {
+        job.succeeded = job.controller->start();
+        if (!job.succeeded)
+            job.error = job.controller->errorMessage();
+        job.finished.store(true, std::memory_order_release);
+    });
+}
+
+void DownloadDaemon::log(const std::string& line) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::cout << line << std::endl;
+}
+
+const char* DownloadDaemon::stateName(JobState state) {
+    switch (state) {
+    case JobState::Queued: return "queued";
+    case JobState::Running: return "running";
+    case JobState::Completed: return "completed";
+    case JobState::Failed: return "failed";
+    case JobState::Cancelled: return "cancelled";
+    }
+    return "?";
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <csignal>
+
+#include "utils.h"
+#include "ConnectionBudget.h"
+#include "RateLimiter.h"
+#include "DownloadController.h"
+#include "../net/CurlShare.h"
+#include "../net/ControlSocket.h"
+
+// Long-running download service. Jobs arrive on a local control socket and
+// run as DownloadControllers that share one connection budget, one
+// bandwidth budget and curl's connection/TLS caches. Queued jobs start in
+// priority order; a job more important than one already running starts
+// regardless of maxActive and takes connections over at segment
+// boundaries.
+//
+// Commands, one per line:
+//   add <priority> <url> [mdm options]   -> ok <id>
+//   list                                 -> one line per job
+//   cancel <id>
+//   shutdown
+class DownloadDaemon {
+public:
+    struct Options {
+        std::string socketPath;
+        std::size_t connections = 16;
+        std::uint64_t bytesPerSec = 0; // 0 = unlimited
+        std::size_t maxActive = 4;
+    };
+
+    explicit DownloadDaemon(const Options& options);
+    ~DownloadDaemon();
+
+    // Serves until shutdown or externalStop; running jobs are stopped and
+    // keep their resume data
+    bool run(volatile std::sig_atomic_t* externalStop = nullptr);
+
+private:
+    enum class JobState { Queued, Running, Completed, Failed, Cancelled };
+
+    struct Job {
+        std::uint64_t id = 0;
+        int priority = 0;
+        DownloadConfig config;
+        JobState state = JobState::Queued;
+        bool cancelRequested = false;
+        std::string error;
+        std::unique_ptr<DownloadController> controller;
+        std::thread thread;
+        std::atomic<bool> finished{ false };
+        bool succeeded = false;
+
+        // Written on the job's own thread
+        std::mutex progressMutex;
+        DownloadProgress progress;
+    };
+
+    std::string handle(const std::string& line);
+    std::string add(const std::string& args);
+    std::string list();
+    std::string cancel(std::uint64_t id);
+    void schedule();
+    void startJob(Job& job);
+    void log(const std::string& line);
+    static const char* stateName(JobState state);
+
+private:
+    Options opts;
+    ConnectionBudget budget;
+    RateLimiter bandwidth;
+    CurlShare curlShare;
+    ControlSocket control;
+
+    std::mutex mtx;
+    std::map<std::uint64_t, std::unique_ptr<Job>> jobs;
+    std::uint64_t nextId{ 1 };
+    std::atomic<bool> stopFlag{ false };
+    std::mutex logMutex;
+};
@@ -1,55 +1,268 @@
 ﻿#include "DownloadWorker.h"
+#include "ConnectionBudget.h"
+#include "RateLimiter.h"
+
+#include <algorithm>
+
+namespace {
+// Multi-range batching only pays off for small, scattered segments
+constexpr std::size_t kMaxBatchRanges = 16;
+constexpr std::uint64_t kMaxBatchSegmentSize = 1024 * 1024;
+constexpr std::uint64_t kMaxBatchBytes = 8 * 1024 * 1024;
+}
 
 DownloadWorker::DownloadWorker(SegmentQueue& queue,
-    FileWriter& writer,
+    OutputSink& sink,
     ConnectionPool& pool,
+    ProgressTracker& progress,
+    std::size_t slot,
     ReportCallback cb,
     std::atomic<bool>& stopFlag)
     : segmentQueue(queue),
-    fileWriter(writer),
+    outputSink(sink),
     connectionPool(pool),
+    progressTracker(progress),
+    progressSlot(slot),
     report(std::move(cb)),
     shouldStop(stopFlag) {
 }
 
 
+void DownloadWorker::setShared(const SharedResources& resources) {
+    shared = resources;
+}
+
+bool DownloadWorker::acquireSlot() {
+    return !shared.connections || shared.connections->acquire(shared.priority, shouldStop);
+}
+
+void DownloadWorker::releaseSlot() {
+    if (shared.connections)
+        shared.connections->release();
+}
+
+void DownloadWorker::throttle(std::size_t bytes) {
+    if (shared.bandwidth)
+        shared.bandwidth->consume(bytes, &shouldStop);
+}
+
 void DownloadWorker::run() {
+    // Work is claimed before the connection slot, so a worker waiting for
+    // a slot (preempted by a more important download) never holds one idle
     while (!shouldStop.load(std::memory_order_relaxed)) {
 
-        auto segOpt = segmentQueue.getNext();
+        auto batch = segmentQueue.getBatch(kMaxBatchRanges, kMaxBatchSegmentSize, kMaxBatchBytes);
+        if (!batch.empty()) {
+            if (!acquireSlot()) {
+                for (const auto& seg : batch)
+                    segmentQueue.release(seg.index);
+                return;
+            }
+            fetchBatch(batch);
+            releaseSlot();
+            continue;
+        }
+
+        auto segOpt = segmentQueue.getNext(progressSlot);
         if (!segOpt.has_value())
             return;
 
-        const Segment seg = *segOpt;
+        if (!acquireSlot()) {
+            segmentQueue.release(segOpt->index);
+            return;
+        }
+        fetchSegment(*segOpt);
+        releaseSlot();
+    }
+}
+
+void DownloadWorker::fetchSegment(const Segment& seg) {
+    WorkerReport rep{};
+    rep.segmentIndex = seg.index;
+    rep.bytesDownloaded = 0;
+    rep.success = false;
 
-        WorkerReport rep{};
-        rep.segmentIndex = seg.index;
-        rep.bytesDownloaded = 0;
-        rep.success = false;
+    // Get connection
+    auto client = connectionPool.acquire();
+    client->setAbortFlag(&shouldStop);
 
-        // Get connection
-        auto client = connectionPool.acquire();
+    // Straight from the socket into the output file when both allow it
+    const SpliceResult direct = client->spliceRange(seg.offset, seg.size, outputSink.directFd(),
+        [&](std::size_t size) {
+            rep.bytesDownloaded += size;
+            progressTracker.add(progressSlot, size);
+            throttle(size);
+            return true;
+        });
 
-        bool ok = client->getRange(
+    const bool ok = direct == SpliceResult::Unsupported
+        ? client->getRange(
             seg.offset,
             seg.size,
             [&](const char* data, std::size_t size) {
-                if (!fileWriter.write(seg.offset + rep.bytesDownloaded, data, size))
-                    return false;
+                return receive(seg, rep, data, size);
+            })
+        : direct == SpliceResult::Ok;
 
-                rep.bytesDownloaded += size;
-                return true;
-            });
+    finish(seg, *client, ok, rep);
+    connectionPool.release(std::move(client));
+}
 
-        connectionPool.release(std::move(client));
+bool DownloadWorker::receive(const Segment& seg, WorkerReport& rep, const char* data, std::size_t size) {
+    // Never past the segment, however long the response is
+    size = static_cast<std::size_t>(std::min<std::uint64_t>(size, seg.size - rep.bytesDownloaded));
+    if (size == 0)
+        return true;
+    if (!outputSink.write(seg.offset + rep.bytesDownloaded, data, size))
+        return false;
 
-        if (ok) {
-            segmentQueue.markDone(seg.index);
-            rep.success = true;
+    rep.bytesDownloaded += size;
+    progressTracker.add(progressSlot, size);
+    throttle(size);
+    return true;
+}
+
+void DownloadWorker::finish(const Segment& seg, HttpClient& client, bool ok, WorkerReport& rep) {
+    // Bytes may still sit in the write pipeline; the segment is only done
+    // once they have reached the output
+    const bool drained = outputSink.drain();
+    if (!drained)
+        ok = false;
+
+    if (ok) {
+        const auto& stats = client.lastStats();
+        segmentQueue.reportThroughput(progressSlot, rep.bytesDownloaded,
+            stats.totalSeconds, stats.firstByteSeconds);
+        outputSink.rangeComplete(seg.offset, seg.size);
+        segmentQueue.markDone(seg.index);
+        rep.success = true;
+    }
+    else if (drained && rep.bytesDownloaded > 0) {
+        // Interrupted (stop request or network error) after some data. Bytes
+        // only get here from a verified range response (getRange, splice,
+        // or the probe after adoptHeaders), so keep them and requeue only
+        // the remainder
+        outputSink.rangeComplete(seg.offset, rep.bytesDownloaded);
+        segmentQueue.markPartial(seg.index, rep.bytesDownloaded);
+        rep.error = shouldStop.load(std::memory_order_relaxed) ? "stopped" : "download interrupted";
+    }
+    else {
+        // Nothing usable arrived, don't count it
+        progressTracker.rollback(progressSlot, rep.bytesDownloaded);
+        rep.bytesDownloaded = 0;
+        if (shouldStop.load(std::memory_order_relaxed)) {
+            segmentQueue.release(seg.index);
+            rep.error = "stopped";
+        }
+        else if (client.lastStats().connectFailed && connectionPool.hasHealthyPath()) {
+            // A dead interface; the pool backs it off, so this is not one
+            // of the segment's attempts
+            segmentQueue.release(seg.index);
+            rep.error = "cannot connect via " + client.interfaceName();
         }
         else {
+            segmentQueue.markFailed(seg.index);
             rep.error = "download failed";
         }
+    }
+
+    report(rep);
+}
+
+void DownloadWorker::fetchBatch(std::vector<Segment>& batch) {
+    std::sort(batch.begin(), batch.end(),
+        [](const Segment& a, const Segment& b) { return a.offset < b.offset; });
+
+    std::vector<ByteRange> ranges;
+    ranges.reserve(batch.size());
+    for (const auto& seg : batch)
+        ranges.push_back({ seg.offset, seg.size });
+
+    // Bytes received per segment; parts must arrive in order within a
+    // segment, anything else (gaps, overlaps) leaves the segment incomplete
+    std::vector<std::uint64_t> received(batch.size(), 0);
+
+    auto client = connectionPool.acquire();
+    client->setAbortFlag(&shouldStop);
+
+    const MultiRangeResult result = client->getRanges(ranges,
+        [&](std::uint64_t offset, const char* data, std::size_t size) {
+            while (size > 0) {
+                auto it = std::upper_bound(batch.begin(), batch.end(), offset,
+                    [](std::uint64_t off, const Segment& s) { return off < s.offset; });
+
+                // Server may coalesce ranges; skip bytes between our segments
+                if (it == batch.begin() || offset >= std::prev(it)->offset + std::prev(it)->size) {
+                    const std::uint64_t next = it == batch.end() ? offset + size : it->offset;
+                    const std::size_t skip = static_cast<std::size_t>(std::min<std::uint64_t>(next - offset, size));
+                    offset += skip;
+                    data += skip;
+                    size -= skip;
+                    continue;
+                }
+
+                const std::size_t i = static_cast<std::size_t>(std::prev(it) - batch.begin());
+                const Segment& seg = batch[i];
+                const std::size_t n = static_cast<std::size_t>(
+                    std::min<std::uint64_t>(seg.offset + seg.size - offset, size));
+
+                if (offset == seg.offset + received[i]) {
+                    if (!outputSink.write(offset, data, n))
+                        return false;
+                    received[i] += n;
+                    progressTracker.add(progressSlot, n);
+                    throttle(n);
+                }
+
+                offset += n;
+                data += n;
+                size -= n;
+            }
+            return true;
+        });
+
+    const bool connectFailed = client->lastStats().connectFailed;
+    connectionPool.release(std::move(client));
+
+    const bool drained = outputSink.drain();
+
+    if (result == MultiRangeResult::SinglePart || result == MultiRangeResult::Unsupported)
+        segmentQueue.setBatching(false);
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        const Segment& seg = batch[i];
+
+        WorkerReport rep{};
+        rep.segmentIndex = seg.index;
+        rep.bytesDownloaded = received[i];
+        rep.success = drained && received[i] == seg.size;
+
+        if (rep.success) {
+            outputSink.rangeComplete(seg.offset, seg.size);
+            segmentQueue.markDone(seg.index);
+        }
+        else if (drained && received[i] > 0) {
+            // Keep the prefix that arrived; fetching the whole segment again
+            // would hand in-order sinks offsets they have already consumed
+            outputSink.rangeComplete(seg.offset, received[i]);
+            segmentQueue.markPartial(seg.index, received[i]);
+            rep.error = shouldStop.load(std::memory_order_relaxed) ? "stopped" : "multi-range response incomplete";
+        }
+        else {
+            progressTracker.rollback(progressSlot, received[i]);
+            rep.bytesDownloaded = 0;
+            if ((result == MultiRangeResult::Failed || !drained) && !shouldStop.load(std::memory_order_relaxed)
+                && !(connectFailed && connectionPool.hasHealthyPath())) {
+                segmentQueue.markFailed(seg.index);
+                rep.error = "multi-range download failed";
+            }
+            else {
+                // Not answered by the server, or we are stopping; it is
+                // fetched again later on its own
+                segmentQueue.release(seg.index);
+                continue;
+            }
+        }
 
         report(rep);
     }
@@ -1,30 +1,53 @@
 #pragma once
 #include <atomic>
+#include <vector>
 #include <functional>
 
 #include "utils.h"
 #include "SegmentQueue.h"
 #include "ConnectionPool.h"
-#include "../io/FileWriter.h"
+#include "../io/OutputSink.h"
 #include "../net/HttpClient.h"
+#include "../monitor/ProgressTracker.h"
 
 class DownloadWorker {
 public:
     using ReportCallback = std::function<void(const WorkerReport&)>;
 
     DownloadWorker(SegmentQueue& queue,
-        FileWriter& writer,
+        OutputSink& sink,
         ConnectionPool& pool,
+        ProgressTracker& progress,
+        std::size_t slot,
         ReportCallback cb,
         std::atomic<bool>& stopFlag);
 
+    // Take connection slots and bandwidth from budgets shared with other
+    // downloads; must be called before run()
+    void setShared(const SharedResources& resources);
+
     void run();
 
+    // Building blocks of fetchSegment(), also used for a segment whose
+    // request was started before this worker existed
+    bool receive(const Segment& seg, WorkerReport& rep, const char* data, std::size_t size);
+    void finish(const Segment& seg, HttpClient& client, bool ok, WorkerReport& rep);
+
+private:
+    bool acquireSlot();
+    void releaseSlot();
+    void throttle(std::size_t bytes);
+    void fetchSegment(const Segment& seg);
+    void fetchBatch(std::vector<Segment>& batch);
+
 private:
     SegmentQueue& segmentQueue;
-    FileWriter& fileWriter;
+    OutputSink& outputSink;
     ConnectionPool& connectionPool;
+    ProgressTracker& progressTracker;
+    std::size_t progressSlot;
     ReportCallback report;
     std::atomic<bool>& shouldStop;
+    SharedResources shared;
 };
 
@@ -0,0 +1,72 @@
+#include "RangeSet.h"
+
+#include <algorithm>
+#include <iterator>
+
+void RangeSet::add(std::uint64_t begin, std::uint64_t end) {
+    if (begin >= end)
+        return;
+
+    auto it = intervals.upper_bound(begin);
+    if (it != intervals.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= begin)
+            it = prev;
+    }
+
+    while (it != intervals.end() && it->first <= end) {
+        begin = std::min(begin, it->first);
+        end = std::max(end, it->second);
+        totalBytes -= it->second - it->first;
+        it = intervals.erase(it);
+    }
+
+    intervals.emplace(begin, end);
+    totalBytes += end - begin;
+}
+
+void RangeSet::clear() {
+    intervals.clear();
+    totalBytes = 0;
+}
+
+bool RangeSet::covers(std::uint64_t begin, std::uint64_t end) const {
+    if (begin >= end)
+        return true;
+
+    auto it = intervals.upper_bound(begin);
+    if (it == intervals.begin())
+        return false;
+    --it;
+    return it->first <= begin && it->second >= end;
+}
+
+bool RangeSet::nextGap(std::uint64_t from, std::uint64_t limit,
+    std::uint64_t& gapBegin, std::uint64_t& gapEnd) const {
+    std::uint64_t pos = from;
+    auto it = intervals.upper_bound(pos);
+    if (it != intervals.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second > pos)
+            pos = prev->second;
+    }
+
+    if (pos >= limit)
+        return false;
+
+    gapBegin = pos;
+    gapEnd = it == intervals.end() ? limit : std::min(it->first, limit);
+    return true;
+}
+
+std::uint64_t RangeSet::bytes() const {
+    return totalBytes;
+}
+
+std::size_t RangeSet::count() const {
+    return intervals.size();
+}
+
+const std::map<std::uint64_t, std::uint64_t>& RangeSet::ranges() const {
+    return intervals;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+// Disjoint half-open byte ranges [begin, end). Overlapping and touching
+// ranges are merged on insert, so the size is the number of fragments, not
+// the number of segments that produced them.
+class RangeSet {
+public:
+    void add(std::uint64_t begin, std::uint64_t end);
+    void clear();
+
+    bool covers(std::uint64_t begin, std::uint64_t end) const;
+    // First range in [from, limit) that is not covered
+    bool nextGap(std::uint64_t from, std::uint64_t limit,
+        std::uint64_t& gapBegin, std::uint64_t& gapEnd) const;
+
+    std::uint64_t bytes() const;
+    std::size_t count() const;
+    // begin -> end
+    const std::map<std::uint64_t, std::uint64_t>& ranges() const;
+
+private:
+    std::map<std::uint64_t, std::uint64_t> intervals;
+    std::uint64_t totalBytes{ 0 };
+};
@@ -0,0 +1,48 @@
+#include "RateLimiter.h"
+
+#include <thread>
+#include <algorithm>
+
+namespace {
+// Unused budget is kept for at most this long, so an idle period does not
+// turn into a burst
+constexpr double kBurstSeconds = 0.25;
+// Longest sleep between checks of the stop flag
+constexpr auto kStopPoll = std::chrono::milliseconds(100);
+}
+
+RateLimiter::RateLimiter(std::uint64_t bytesPerSec)
+    : rate(static_cast<double>(bytesPerSec)),
+    burst(static_cast<double>(bytesPerSec) * kBurstSeconds),
+    tokens(burst),
+    last(std::chrono::steady_clock::now()) {
+}
+
+void RateLimiter::consume(std::size_t bytes, const std::atomic<bool>* stop) {
+    if (rate <= 0.0)
+        return;
+
+    std::chrono::steady_clock::time_point wakeAt;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+        tokens = std::min(burst, tokens + elapsed * rate);
+
+        // Going into debt makes later callers wait their share as well
+        tokens -= static_cast<double>(bytes);
+        if (tokens >= 0.0)
+            return;
+        wakeAt = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(-tokens / rate));
+    }
+    for (;;) {
+        if (stop && stop->load(std::memory_order_relaxed))
+            return;
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= wakeAt)
+            return;
+        std::this_thread::sleep_until(std::min<std::chrono::steady_clock::time_point>(wakeAt, now + kStopPoll));
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Token bucket shared by every transfer it is given to. consume() is called
+// from receive callbacks after the bytes arrived; when over budget it
+// sleeps, which stops reading the socket and lets TCP slow the sender.
+class RateLimiter {
+public:
+    // 0 bytes per second = unlimited
+    explicit RateLimiter(std::uint64_t bytesPerSec);
+
+    // Returns early once stop is set, so a throttled transfer still aborts
+    // promptly
+    void consume(std::size_t bytes, const std::atomic<bool>* stop = nullptr);
+
+private:
+    double rate;
+    double burst;
+    double tokens;
+    std::chrono::steady_clock::time_point last;
+    std::mutex mtx;
+};
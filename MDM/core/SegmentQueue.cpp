@@ -1,36 +1,298 @@
 #include "SegmentQueue.h"
 
-SegmentQueue::SegmentQueue(std::vector<Segment>& segments)
-    : segmentsRef(segments) {
+#include <algorithm>
+
+namespace {
+constexpr unsigned kMaxAttempts = 3;
+}
+
+SegmentQueue::SegmentQueue(const RangeSet& done, std::uint64_t fileSize, std::uint64_t defaultSize)
+    : doneRanges(done),
+    totalSize(fileSize),
+    fixedSize(defaultSize == 0 ? 1 : defaultSize) {
+}
+
+void SegmentQueue::setSizer(SegmentSizer* s, std::size_t workers) {
+    std::lock_guard<std::mutex> lock(mtx);
+    sizer = s;
+    workerCount = workers == 0 ? 1 : workers;
 }
 
-std::optional<Segment> SegmentQueue::getNext() {
+std::uint64_t SegmentQueue::carveSize(std::size_t slot, std::uint64_t offset) const {
+    const std::uint64_t remaining = totalSize - offset;
+    std::uint64_t size = sizer
+        ? sizer->nextSize(slot, remaining, workerCount)
+        : std::min(fixedSize, remaining);
+    return size == 0 ? remaining : size;
+}
+
+void SegmentQueue::setWindow(std::uint64_t bytes) {
     std::lock_guard<std::mutex> lock(mtx);
-    for (auto& seg : segmentsRef) {
-        if (seg.state == SegmentState::Pending) {
+    window = bytes;
+}
+
+void SegmentQueue::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        cancelled = true;
+    }
+    progressCv.notify_all();
+}
+
+std::uint64_t SegmentQueue::prefixLocked() const {
+    std::uint64_t gapBegin = 0;
+    std::uint64_t gapEnd = 0;
+    return doneRanges.nextGap(0, totalSize, gapBegin, gapEnd) ? gapBegin : totalSize;
+}
+
+std::uint64_t SegmentQueue::windowLimit() const {
+    if (window == 0)
+        return totalSize;
+    const std::uint64_t prefix = prefixLocked();
+    return totalSize - prefix > window ? prefix + window : totalSize;
+}
+
+std::optional<Segment> SegmentQueue::getNext(std::size_t slot) {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+        if (cancelled)
+            return std::nullopt;
+
+        if (!pending.empty()) {
+            auto it = pending.begin();
+            if (window > 0) {
+                it = std::min_element(pending.begin(), pending.end(), [](const Segment& a, const Segment& b) {
+                    return a.offset < b.offset;
+                });
+            }
+            Segment seg = *it;
+            pending.erase(it);
             seg.state = SegmentState::InProgress;
+            active[seg.index] = seg;
+            return seg;
+        }
+
+        std::uint64_t gapBegin = 0;
+        std::uint64_t gapEnd = 0;
+        if (!doneRanges.nextGap(cursor, totalSize, gapBegin, gapEnd)) {
+            cursor = totalSize;
+            return std::nullopt;
+        }
+
+        const std::uint64_t limit = windowLimit();
+        if (gapBegin < limit) {
+            Segment seg{
+                nextIndex++,
+                gapBegin,
+                std::min({ carveSize(slot, gapBegin), gapEnd - gapBegin, limit - gapBegin }),
+                SegmentState::InProgress
+            };
+            active[seg.index] = seg;
+            cursor = seg.offset + seg.size;
             return seg;
         }
+
+        // Ahead of the window; whatever holds the prefix back is in flight
+        // and will either finish or come back as a retry
+        if (active.empty())
+            return std::nullopt;
+        progressCv.wait(lock);
     }
-    return std::nullopt;
 }
 
-void SegmentQueue::markDone(std::uint64_t segmentIndex) {
+std::vector<Segment> SegmentQueue::getBatch(std::size_t maxCount, std::uint64_t maxSegmentSize, std::uint64_t maxBytes) {
     std::lock_guard<std::mutex> lock(mtx);
-    for (auto& seg : segmentsRef) {
-        if (seg.index == segmentIndex) {
-            seg.state = SegmentState::Done;
+    std::vector<Segment> batch;
+    if (!batching)
+        return batch;
+
+    std::uint64_t bytes = 0;
+    std::vector<std::size_t> taken;
+    for (std::size_t i = 0; i < pending.size() && batch.size() < maxCount; ++i) {
+        const Segment& seg = pending[i];
+        if (seg.size > maxSegmentSize)
+            continue;
+        if (bytes + seg.size > maxBytes)
             break;
-        }
+        batch.push_back(seg);
+        taken.push_back(i);
+        bytes += seg.size;
+    }
+
+    // Small holes between finished ranges (resume, delta) qualify as well;
+    // stop at the first large one, that is regular getNext() work
+    std::uint64_t pos = cursor;
+    std::uint64_t gapBegin = 0;
+    std::uint64_t gapEnd = 0;
+    const std::uint64_t limit = windowLimit();
+    while (batch.size() < maxCount && doneRanges.nextGap(pos, limit, gapBegin, gapEnd)) {
+        const std::uint64_t size = gapEnd - gapBegin;
+        if (size > maxSegmentSize || bytes + size > maxBytes)
+            break;
+        batch.push_back({ 0, gapBegin, size, SegmentState::Pending });
+        bytes += size;
+        pos = gapEnd;
+    }
+
+    if (batch.size() < 2) {
+        batch.clear();
+        return batch;
+    }
+
+    for (auto it = taken.rbegin(); it != taken.rend(); ++it)
+        pending.erase(pending.begin() + static_cast<std::ptrdiff_t>(*it));
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (i >= taken.size())
+            batch[i].index = nextIndex++;
+        batch[i].state = SegmentState::InProgress;
+        active[batch[i].index] = batch[i];
     }
+    cursor = pos;
+    return batch;
 }
 
-bool SegmentQueue::hasPending() const {
+void SegmentQueue::setBatching(bool enabled) {
     std::lock_guard<std::mutex> lock(mtx);
-    for (const auto& seg : segmentsRef) {
-        if (seg.state == SegmentState::Pending) {
-            return true;
-        }
+    batching = enabled;
+}
+
+std::optional<Segment> SegmentQueue::claim(std::uint64_t offset, std::uint64_t size) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::uint64_t gapBegin = 0;
+    std::uint64_t gapEnd = 0;
+    if (size == 0 || offset != cursor || offset + size > totalSize
+        || !doneRanges.nextGap(offset, offset + size, gapBegin, gapEnd)
+        || gapBegin != offset || gapEnd != offset + size)
+        return std::nullopt;
+
+    Segment seg{ nextIndex++, offset, size, SegmentState::InProgress };
+    active[seg.index] = seg;
+    cursor = offset + size;
+    return seg;
+}
+
+void SegmentQueue::markDone(std::uint64_t segmentIndex) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = active.find(segmentIndex);
+    if (it == active.end())
+        return;
+
+    doneRanges.add(it->second.offset, it->second.offset + it->second.size);
+    ++doneSegments;
+    attempts.erase(segmentIndex);
+    active.erase(it);
+    progressCv.notify_all();
+}
+
+void SegmentQueue::release(std::uint64_t segmentIndex) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = active.find(segmentIndex);
+    if (it == active.end())
+        return;
+
+    it->second.state = SegmentState::Pending;
+    pending.push_front(it->second);
+    active.erase(it);
+    progressCv.notify_all();
+}
+
+void SegmentQueue::markFailed(std::uint64_t segmentIndex) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = active.find(segmentIndex);
+    if (it == active.end())
+        return;
+
+    // An exhausted segment stays active so the download never completes
+    if (++attempts[segmentIndex] >= kMaxAttempts) {
+        permanentFailure = true;
+        return;
+    }
+
+    it->second.state = SegmentState::Pending;
+    pending.push_back(it->second);
+    active.erase(it);
+    progressCv.notify_all();
+}
+
+void SegmentQueue::reportThroughput(std::size_t slot, std::uint64_t bytes, double seconds, double rttSeconds) {
+    SegmentSizer* s = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        s = sizer;
     }
-    return false;
+    if (s)
+        s->record(slot, bytes, seconds, rttSeconds);
+}
+
+void SegmentQueue::markPartial(std::uint64_t segmentIndex, std::uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = active.find(segmentIndex);
+    if (it == active.end())
+        return;
+
+    Segment seg = it->second;
+    active.erase(it);
+    progressCv.notify_all();
+
+    if (bytes == 0) {
+        seg.state = SegmentState::Pending;
+        pending.push_back(seg);
+        return;
+    }
+
+    bytes = std::min(bytes, seg.size);
+    doneRanges.add(seg.offset, seg.offset + bytes);
+    ++doneSegments;
+
+    if (bytes < seg.size) {
+        pending.push_back({
+            nextIndex++,
+            seg.offset + bytes,
+            seg.size - bytes,
+            SegmentState::Pending
+            });
+    }
+}
+
+void SegmentQueue::snapshot(RangeSet& out) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    out = doneRanges;
+}
+
+std::uint64_t SegmentQueue::contiguousPrefix() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return prefixLocked();
+}
+
+bool SegmentQueue::hasPending() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::uint64_t gapBegin = 0;
+    std::uint64_t gapEnd = 0;
+    return !pending.empty() || doneRanges.nextGap(cursor, totalSize, gapBegin, gapEnd);
+}
+
+bool SegmentQueue::allDone() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return doneRanges.covers(0, totalSize);
+}
+
+bool SegmentQueue::hasFailed() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return permanentFailure;
+}
+
+std::size_t SegmentQueue::doneCount() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return doneSegments;
+}
+
+std::size_t SegmentQueue::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return static_cast<std::size_t>(nextIndex);
+}
+
+std::size_t SegmentQueue::fragmentCount() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return doneRanges.count();
 }
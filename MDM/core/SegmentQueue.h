@@ -1,19 +1,85 @@
 #pragma once
 #include <vector>
+#include <deque>
 #include <mutex>
+#include <condition_variable>
 #include <optional>
+#include <unordered_map>
 #include "utils.h"
+#include "RangeSet.h"
+#include "SegmentSizer.h"
 
 class SegmentQueue {
 public:
-    explicit SegmentQueue(std::vector<Segment>& segments);
+    // Segments are carved lazily from the ranges not in `done`, `defaultSize`
+    // bytes at a time unless a sizer is attached. Only segments in flight or
+    // waiting for a retry are held individually; finished ones are merged
+    // into a RangeSet, so memory follows fragmentation, not file size.
+    SegmentQueue(const RangeSet& done, std::uint64_t fileSize, std::uint64_t defaultSize);
+
+    void setSizer(SegmentSizer* sizer, std::size_t workers);
+    // Sequential mode: nothing starting `bytes` or more past the contiguous
+    // prefix is handed out, and retries go lowest offset first. getNext()
+    // then waits for the prefix to advance instead of returning early.
+    void setWindow(std::uint64_t bytes);
+    // Wake and fail every waiting getNext(); used when stopping
+    void cancel();
+
+    std::optional<Segment> getNext(std::size_t slot = 0);
+    // Scattered pending segments (retries, resume gaps) that can share one
+    // multi-range request. Empty if batching is off or fewer than two
+    // qualify, in which case getNext() should be used.
+    std::vector<Segment> getBatch(std::size_t maxCount, std::uint64_t maxSegmentSize, std::uint64_t maxBytes);
+    void setBatching(bool enabled);
+    // Hand out exactly [offset, offset + size) as a segment that is already
+    // being fetched elsewhere. Fails if any of it is done or planned.
+    std::optional<Segment> claim(std::uint64_t offset, std::uint64_t size);
 
-    std::optional<Segment> getNext();
     void markDone(std::uint64_t segmentIndex);
+    // Give a segment back without counting an attempt
+    void release(std::uint64_t segmentIndex);
+    // Requeue a failed segment until it runs out of attempts
+    void markFailed(std::uint64_t segmentIndex);
+    // Keep the first `bytes` of an interrupted segment as done and queue the
+    // rest as a new segment; nothing is lost and no attempt is counted.
+    void markPartial(std::uint64_t segmentIndex, std::uint64_t bytes);
+    void reportThroughput(std::size_t slot, std::uint64_t bytes, double seconds, double rttSeconds);
+
+    // Consistent copy of the finished ranges
+    void snapshot(RangeSet& out) const;
+    // Bytes from the start of the file that are all done
+    std::uint64_t contiguousPrefix() const;
 
     bool hasPending() const;
+    bool allDone() const;
+    bool hasFailed() const;
+    std::size_t doneCount() const;
+    // Segments planned so far
+    std::size_t size() const;
+    std::size_t fragmentCount() const;
+
+private:
+    std::uint64_t carveSize(std::size_t slot, std::uint64_t offset) const;
+    std::uint64_t prefixLocked() const;
+    std::uint64_t windowLimit() const;
 
 private:
-    std::vector<Segment>& segmentsRef;
+    RangeSet doneRanges;
+    std::deque<Segment> pending;
+    std::unordered_map<std::uint64_t, Segment> active;
+    std::uint64_t totalSize;
+    // Everything below has been handed out at least once
+    std::uint64_t cursor{ 0 };
+    std::uint64_t nextIndex{ 0 };
+    std::uint64_t fixedSize;
+    SegmentSizer* sizer{ nullptr };
+    std::size_t workerCount{ 1 };
+    std::size_t doneSegments{ 0 };
+    bool batching{ false };
+    bool permanentFailure{ false };
+    std::uint64_t window{ 0 };
+    bool cancelled{ false };
+    std::unordered_map<std::uint64_t, unsigned> attempts;
     mutable std::mutex mtx;
+    std::condition_variable progressCv;
 };
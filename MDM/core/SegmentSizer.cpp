@@ -0,0 +1,60 @@
+#include "SegmentSizer.h"
+
+#include <algorithm>
+
+namespace {
+// A segment should last at least this long so rate samples are meaningful.
+constexpr double kMinSegmentSeconds = 2.0;
+// ...and at least this many RTTs so request latency stays below ~5%.
+constexpr double kRttMultiple = 20.0;
+// Grow at most this much per segment, like TCP slow start.
+constexpr double kMaxGrowth = 2.0;
+constexpr double kSmoothing = 0.3;
+}
+
+SegmentSizer::SegmentSizer(std::size_t slots,
+    std::uint64_t initialSize,
+    std::uint64_t minSize,
+    std::uint64_t maxSize)
+    : minSegment(minSize), maxSegment(std::max(minSize, maxSize)) {
+    if (slots == 0)
+        slots = 1;
+    state.assign(slots, SlotState{ std::clamp(initialSize, minSegment, maxSegment) });
+}
+
+std::uint64_t SegmentSizer::nextSize(std::size_t slot, std::uint64_t remaining, std::size_t activeWorkers) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (slot >= state.size())
+        slot = 0;
+
+    std::uint64_t size = state[slot].size;
+
+    // Tail: split what is left evenly so no single connection is the long pole
+    if (activeWorkers > 0) {
+        const std::uint64_t share = std::max<std::uint64_t>(minSegment, remaining / activeWorkers);
+        size = std::min(size, share);
+    }
+
+    return std::min(size, remaining);
+}
+
+void SegmentSizer::record(std::size_t slot, std::uint64_t bytes, double seconds, double rttSeconds) {
+    if (bytes == 0 || seconds <= 0.0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (slot >= state.size())
+        slot = 0;
+
+    auto& s = state[slot];
+    const double rate = static_cast<double>(bytes) / seconds;
+    s.rate = s.rate <= 0.0 ? rate : s.rate + kSmoothing * (rate - s.rate);
+    if (rttSeconds > 0.0)
+        s.rtt = s.rtt <= 0.0 ? rttSeconds : s.rtt + kSmoothing * (rttSeconds - s.rtt);
+
+    const double targetSeconds = std::max(kMinSegmentSeconds, kRttMultiple * s.rtt);
+    const double target = s.rate * targetSeconds;
+    const double grown = static_cast<double>(s.size) * kMaxGrowth;
+
+    s.size = std::clamp(static_cast<std::uint64_t>(std::min(target, grown)), minSegment, maxSegment);
+}
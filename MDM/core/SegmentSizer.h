@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Decides how large the next segment handed to a connection should be.
+// Each connection starts with a small probe and grows towards a size that
+// keeps per-request overhead (one RTT plus slow start) small relative to the
+// transfer time; near the end of the file sizes shrink so all connections
+// finish together.
+class SegmentSizer {
+public:
+    SegmentSizer(std::size_t slots,
+        std::uint64_t initialSize,
+        std::uint64_t minSize,
+        std::uint64_t maxSize);
+
+    std::uint64_t nextSize(std::size_t slot, std::uint64_t remaining, std::size_t activeWorkers);
+    void record(std::size_t slot, std::uint64_t bytes, double seconds, double rttSeconds);
+
+private:
+    struct SlotState {
+        std::uint64_t size;
+        double rate{ 0.0 };
+        double rtt{ 0.0 };
+    };
+
+    std::vector<SlotState> state;
+    std::uint64_t minSegment;
+    std::uint64_t maxSegment;
+    std::mutex mtx;
+};
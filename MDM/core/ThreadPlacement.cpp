@@ -0,0 +1,127 @@
+#include "ThreadPlacement.h"
+
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ThreadPlacement {
+
+namespace {
+// Whole string must be a non-negative decimal number
+bool parseCpu(const std::string& text, int& cpu) {
+    if (text.empty() || text.size() > 6
+        || !std::all_of(text.begin(), text.end(), [](unsigned char ch) { return std::isdigit(ch) != 0; }))
+        return false;
+    cpu = std::stoi(text);
+    return true;
+}
+}
+
+bool parseCpuList(const std::string& list, CpuSet& out) {
+    CpuSet cpus;
+    std::stringstream ss(list);
+    std::string part;
+
+    while (std::getline(ss, part, ',')) {
+        part.erase(std::remove_if(part.begin(), part.end(), [](unsigned char ch) { return std::isspace(ch) != 0; }), part.end());
+        if (part.empty())
+            continue;
+
+        const auto dash = part.find('-');
+        int first = 0;
+        int last = 0;
+        if (dash == std::string::npos) {
+            if (!parseCpu(part, first))
+                return false;
+            last = first;
+        }
+        else if (!parseCpu(part.substr(0, dash), first) || !parseCpu(part.substr(dash + 1), last) || last < first) {
+            return false;
+        }
+        for (int c = first; c <= last; ++c)
+            cpus.push_back(c);
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    out = std::move(cpus);
+    return true;
+}
+
+bool pinCurrentThread(const CpuSet& cpus) {
+    if (cpus.empty())
+        return false;
+
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (int c : cpus) {
+        if (c >= 0 && c < static_cast<int>(sizeof(DWORD_PTR) * 8))
+            mask |= (static_cast<DWORD_PTR>(1) << c);
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) {
+        if (c >= 0 && c < CPU_SETSIZE)
+            CPU_SET(c, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+int nicNumaNode(const std::string& iface) {
+#ifdef __linux__
+    if (iface.empty())
+        return -1;
+    std::ifstream in("/sys/class/net/" + iface + "/device/numa_node");
+    int node = -1;
+    if (in >> node)
+        return node;
+#else
+    (void)iface;
+#endif
+    return -1;
+}
+
+CpuSet cpusOfNode(int node) {
+#ifdef __linux__
+    if (node < 0)
+        return {};
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    CpuSet cpus;
+    if (std::getline(in, list) && parseCpuList(list, cpus))
+        return cpus;
+#else
+    (void)node;
+#endif
+    return {};
+}
+
+void runOn(const CpuSet& cpus, const std::function<void()>& fn) {
+    if (cpus.empty()) {
+        fn();
+        return;
+    }
+
+    std::thread t([&]() {
+        pinCurrentThread(cpus);
+        fn();
+        });
+    t.join();
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+// CPU sets and NUMA topology helpers. On platforms without affinity
+// support the setters are no-ops and topology queries return nothing.
+namespace ThreadPlacement {
+    using CpuSet = std::vector<int>;
+
+    // "0-7,16,18-19" -> {0..7,16,18,19}; false on a syntax error
+    bool parseCpuList(const std::string& list, CpuSet& out);
+
+    // Pin the calling thread; false if not supported or rejected
+    bool pinCurrentThread(const CpuSet& cpus);
+
+    // NUMA node the network interface is attached to, -1 if unknown
+    int nicNumaNode(const std::string& iface);
+    CpuSet cpusOfNode(int node);
+
+    // Run fn on a short-lived thread pinned to cpus, so that memory it first
+    // touches is placed on their node.
+    void runOn(const CpuSet& cpus, const std::function<void()>& fn);
+}
@@ -1,4 +1,5 @@
 ﻿#include "ThreadPool.h"
+#include "ThreadPlacement.h"
 
 ThreadPool::ThreadPool(std::atomic<bool>& stopFlag)
     : shouldStop(stopFlag) {
@@ -8,11 +9,24 @@ ThreadPool::~ThreadPool() {
     shutdown();
 }
 
+void ThreadPool::setAffinity(const std::vector<int>& cpus) {
+    std::lock_guard<std::mutex> lock(mtx);
+    affinity = cpus;
+}
+
 void ThreadPool::start(std::size_t n, WorkerFn worker) {
     std::lock_guard<std::mutex> lock(mtx);
 
     for (std::size_t i = 0; i < n; ++i) {
-        threads.emplace_back(worker);
+        if (affinity.empty()) {
+            threads.emplace_back(worker);
+            continue;
+        }
+
+        threads.emplace_back([cpus = affinity, worker]() {
+            ThreadPlacement::pinCurrentThread(cpus);
+            worker();
+            });
     }
 }
 
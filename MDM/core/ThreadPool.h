@@ -12,6 +12,9 @@ public:
     explicit ThreadPool(std::atomic<bool>& stopFlag);
     ~ThreadPool();
 
+    // CPUs that threads started from now on are pinned to; empty = no pinning
+    void setAffinity(const std::vector<int>& cpus);
+
     void start(std::size_t n, WorkerFn worker);
     void scaleUp(std::size_t n, WorkerFn worker);
     void scaleDown(std::size_t n);
@@ -21,6 +24,7 @@ public:
 
 private:
     std::vector<std::thread> threads;
+    std::vector<int> affinity;
     std::atomic<bool>& shouldStop;
     mutable std::mutex mtx;
 };
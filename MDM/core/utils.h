@@ -1,15 +1,118 @@
-#pragma once
+﻿#pragma once
 #include <string>
 #include <vector>
 #include <cstdint>
 #include <cstddef>
 
+#include "RangeSet.h"
+
+enum class CompressionFormat {
+    None,
+    Gzip,    // gzip or zlib framing
+    Deflate, // raw deflate, as stored in ZIP members
+    Zstd
+};
+
+enum class DurabilityMode {
+    None,       // never sync; the resume file is best effort
+    Periodic,   // group commit every checkpointInterval
+    Checkpoint  // group commit as soon as segments complete
+};
+
+// Applied to every data connection; zero or empty keeps the OS default
+struct SocketOptions {
+    int receiveBuffer = 0;      // SO_RCVBUF bytes; fixes the window (no autotuning)
+    std::string congestion;     // TCP_CONGESTION, e.g. "bbr"
+    int keepAliveSeconds = 0;   // idle time before keepalive probes
+    long lowSpeedLimit = 0;     // abort a transfer slower than this many bytes/s
+    long lowSpeedSeconds = 30;  // for this long
+};
+
+class ConnectionBudget;
+class RateLimiter;
+class CurlShare;
+
+// Resources shared by the downloads of one process (daemon mode); any of
+// them may be null. They must outlive the downloads using them.
+struct SharedResources {
+    ConnectionBudget* connections = nullptr;
+    RateLimiter* bandwidth = nullptr;
+    CurlShare* curlShare = nullptr;
+    // Higher wins connection slots first
+    int priority = 0;
+};
+
 struct DownloadConfig {
     std::string url;
     std::string outputPath;
+    // Send a HEAD before downloading instead of planning from the first GET
+    bool headFirst = false;
+
+    std::size_t segmentSize = 256 * 1024;
+    std::size_t maxThreads = 0; // 0 = auto
+    // Dedicated disk writer threads fed by the download workers; 0 writes
+    // inline from the receive callback
+    std::size_t writerThreads = 2;
+
+    // CPU lists ("0-7,16") for thread pinning; empty = no pinning, except
+    // that workers and writers default to the CPUs of nicInterface's node
+    std::string workerCpus;
+    std::string writerCpus;
+    std::string loggerCpus;
+    std::string nicInterface;
+
+    // Local interfaces or source addresses to spread connections over;
+    // empty = default route
+    std::vector<std::string> bindInterfaces;
+
+    // Splice plain-http bodies from the socket into the output file
+    bool zeroCopy = false;
+
+    SocketOptions socket;
+
+    // When set, segment boundaries are chosen at runtime from measured
+    // throughput and RTT; segmentSize is then the initial probe size and
+    // lower bound, maxSegmentSize the upper bound.
+    bool adaptiveSegments = true;
+    std::size_t maxSegmentSize = 64 * 1024 * 1024;
+
+    // Sequential mode when non-zero: workers stay within this many bytes of
+    // the first incomplete offset, and the complete prefix is published in
+    // <outputPath>.prefix for readers tailing the file
+    std::uint64_t sequentialWindow = 0;
+
+    // Decode the stream while downloading; outputPath is then the decoded
+    // file, or the target directory when extractTar is set.
+    CompressionFormat decompress = CompressionFormat::None;
+    bool extractTar = false;
+    std::string keepCompressedPath;
+
+    // Reuse blocks of a previous local version; deltaIndex is a path or URL
+    // of the published block index of the remote file
+    std::string deltaBasePath;
+    std::string deltaIndex;
+
+    // Fetch only these members of a remote ZIP or uncompressed tar into the
+    // directory outputPath; a name ending in '/' selects a whole folder
+    std::vector<std::string> archiveMembers;
+    bool archiveTar = false;
+
+    // Resume metadata is kept in <outputPath>.mdm while downloading
+    DurabilityMode durability = DurabilityMode::Periodic;
+    std::size_t checkpointIntervalMs = 5000;
+
+    // Evict completed ranges from the page cache once they are on disk
+    bool dropPageCache = true;
+
+    // Shared cache of completed downloads, revalidated by ETag; empty = off
+    std::string cacheDir;
+};
 
-    std::size_t segmentSize;
-    std::size_t maxThreads;
+struct DownloadProgress {
+    std::uint64_t downloaded = 0;
+    std::uint64_t total = 0;
+    double bytesPerSec = 0.0;
+    double etaSeconds = -1.0; // negative if unknown
 };
 
 enum class SegmentState {
@@ -32,11 +135,13 @@ struct DownloadMetadata {
     std::uint64_t fileSize;
     std::uint64_t completedBytes;
 
-    std::vector<Segment> segments;
+    // Byte ranges already in the output; everything else is still to fetch
+    RangeSet done;
 };
 
 struct WorkerReport {
     std::uint64_t segmentIndex;
+    // Bytes of the segment that were kept, also on failure
     std::uint64_t bytesDownloaded;
     bool success;
     std::string error;
@@ -0,0 +1,193 @@
+#include "ArchiveFormat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr std::uint32_t kEndSig = 0x06054b50;
+constexpr std::uint32_t kZip64LocatorSig = 0x07064b50;
+constexpr std::uint32_t kZip64EndSig = 0x06064b50;
+constexpr std::uint32_t kCentralSig = 0x02014b50;
+constexpr std::uint32_t kLocalSig = 0x04034b50;
+
+std::uint16_t le16(const char* p) {
+    const auto* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<std::uint16_t>(u[0] | (u[1] << 8));
+}
+
+std::uint32_t le32(const char* p) {
+    return static_cast<std::uint32_t>(le16(p)) | (static_cast<std::uint32_t>(le16(p + 2)) << 16);
+}
+
+std::uint64_t le64(const char* p) {
+    return static_cast<std::uint64_t>(le32(p)) | (static_cast<std::uint64_t>(le32(p + 4)) << 32);
+}
+
+std::string field(const char* p, std::size_t n) {
+    return std::string(p, strnlen(p, n));
+}
+}
+
+bool ZipDirectory::findEnd(const char* tail, std::size_t size, End& out) {
+    if (size < 22)
+        return false;
+
+    // The end record is followed only by its comment, so search backwards
+    for (std::size_t pos = size - 22 + 1; pos-- > 0;) {
+        if (le32(tail + pos) != kEndSig)
+            continue;
+        if (pos + 22 + le16(tail + pos + 20) != size)
+            continue;
+
+        out = End{};
+        out.cdSize = le32(tail + pos + 12);
+        out.cdOffset = le32(tail + pos + 16);
+
+        const bool needs64 = le16(tail + pos + 10) == 0xFFFF
+            || out.cdSize == 0xFFFFFFFFu || out.cdOffset == 0xFFFFFFFFu;
+        if (pos >= 20 && le32(tail + pos - 20) == kZip64LocatorSig) {
+            out.zip64 = true;
+            out.zip64RecordOffset = le64(tail + pos - 20 + 8);
+        }
+        else if (needs64) {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool ZipDirectory::parseZip64End(const char* data, std::size_t size, End& out) {
+    if (size < kZip64EndSize || le32(data) != kZip64EndSig)
+        return false;
+    out.cdSize = le64(data + 40);
+    out.cdOffset = le64(data + 48);
+    return true;
+}
+
+bool ZipDirectory::localHeaderLength(const char* data, std::size_t size, std::uint64_t& length) {
+    if (size < kLocalHeaderSize || le32(data) != kLocalSig)
+        return false;
+    length = kLocalHeaderSize + le16(data + 26) + le16(data + 28);
+    return true;
+}
+
+bool ZipDirectory::parse(const char* data, std::size_t size) {
+    list.clear();
+
+    std::size_t pos = 0;
+    while (pos + 46 <= size && le32(data + pos) == kCentralSig) {
+        const char* h = data + pos;
+        const std::size_t nameLen = le16(h + 28);
+        const std::size_t extraLen = le16(h + 30);
+        const std::size_t commentLen = le16(h + 32);
+        if (pos + 46 + nameLen + extraLen + commentLen > size)
+            return false;
+
+        ZipEntry e;
+        e.flags = le16(h + 8);
+        e.method = le16(h + 10);
+        e.crc = le32(h + 16);
+        e.compressedSize = le32(h + 20);
+        e.size = le32(h + 24);
+        e.localHeaderOffset = le32(h + 42);
+        e.name.assign(h + 46, nameLen);
+
+        // ZIP64 extra field: only the saturated values are present, in order
+        const char* extra = h + 46 + nameLen;
+        std::size_t x = 0;
+        while (x + 4 <= extraLen) {
+            const std::uint16_t id = le16(extra + x);
+            const std::uint16_t len = le16(extra + x + 2);
+            if (x + 4 + len > extraLen)
+                break;
+            if (id == 0x0001) {
+                const char* v = extra + x + 4;
+                const char* end = v + len;
+                if (e.size == 0xFFFFFFFFu && v + 8 <= end) {
+                    e.size = le64(v);
+                    v += 8;
+                }
+                if (e.compressedSize == 0xFFFFFFFFu && v + 8 <= end) {
+                    e.compressedSize = le64(v);
+                    v += 8;
+                }
+                if (e.localHeaderOffset == 0xFFFFFFFFu && v + 8 <= end)
+                    e.localHeaderOffset = le64(v);
+            }
+            x += 4 + len;
+        }
+
+        list.push_back(std::move(e));
+        pos += 46 + nameLen + extraLen + commentLen;
+    }
+    return pos == size;
+}
+
+const std::vector<ZipEntry>& ZipDirectory::entries() const {
+    return list;
+}
+
+std::uint64_t TarFormat::parseNumber(const char* p, std::size_t n) {
+    if (n > 0 && (static_cast<unsigned char>(p[0]) & 0x80)) {
+        std::uint64_t v = 0;
+        for (std::size_t i = 1; i < n; ++i)
+            v = (v << 8) | static_cast<unsigned char>(p[i]);
+        return v;
+    }
+
+    std::uint64_t v = 0;
+    std::size_t i = 0;
+    while (i < n && (p[i] == ' ' || p[i] == '\0'))
+        ++i;
+    for (; i < n && p[i] >= '0' && p[i] <= '7'; ++i)
+        v = (v << 3) | static_cast<std::uint64_t>(p[i] - '0');
+    return v;
+}
+
+std::uint64_t TarFormat::padding(std::uint64_t size) {
+    return (kBlock - size % kBlock) % kBlock;
+}
+
+bool TarFormat::isEndBlock(const char* block) {
+    return std::all_of(block, block + kBlock, [](char c) { return c == '\0'; });
+}
+
+bool TarFormat::parseHeader(const char* block, TarHeader& out) {
+    std::uint32_t sum = 0;
+    for (std::size_t i = 0; i < kBlock; ++i)
+        sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(block[i]);
+    if (sum != parseNumber(block + 148, 8))
+        return false;
+
+    out.type = block[156];
+    out.size = parseNumber(block + 124, 12);
+    out.name = field(block, 100);
+    if (std::memcmp(block + 257, "ustar", 5) == 0) {
+        const std::string prefix = field(block + 345, 155);
+        if (!prefix.empty())
+            out.name = prefix + "/" + out.name;
+    }
+    return true;
+}
+
+std::string TarFormat::paxPath(const std::string& records) {
+    // "<len> <key>=<value>\n"
+    std::string path;
+    std::size_t pos = 0;
+    while (pos < records.size()) {
+        const std::size_t len = std::strtoull(records.c_str() + pos, nullptr, 10);
+        if (len == 0 || pos + len > records.size())
+            break;
+        const std::string rec = records.substr(pos, len);
+        const std::size_t sp = rec.find(' ');
+        const std::size_t eq = rec.find('=');
+        if (sp != std::string::npos && eq != std::string::npos && eq > sp
+            && rec.compare(sp + 1, eq - sp - 1, "path") == 0) {
+            path = rec.substr(eq + 1, rec.size() - eq - 2);
+        }
+        pos += len;
+    }
+    return path;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "../core/utils.h"
+
+// A member of a remote archive and where its bytes are
+struct ArchiveMember {
+    std::string name;
+    std::uint64_t dataOffset = 0;
+    std::uint64_t storedSize = 0;   // bytes in the archive
+    std::uint64_t size = 0;         // bytes once extracted
+    CompressionFormat format = CompressionFormat::None;
+};
+
+struct ZipEntry {
+    std::string name;
+    std::uint16_t flags = 0;
+    std::uint16_t method = 0;
+    std::uint32_t crc = 0;
+    std::uint64_t compressedSize = 0;
+    std::uint64_t size = 0;
+    std::uint64_t localHeaderOffset = 0;
+};
+
+// ZIP end records and central directory, including ZIP64.
+class ZipDirectory {
+public:
+    struct End {
+        bool zip64 = false;
+        // Where the ZIP64 end record is; set when zip64 is
+        std::uint64_t zip64RecordOffset = 0;
+        std::uint64_t cdOffset = 0;
+        std::uint64_t cdSize = 0;
+    };
+
+    static constexpr std::size_t kMaxEndSize = 22 + 65535 + 20;
+    static constexpr std::size_t kZip64EndSize = 56;
+    static constexpr std::size_t kLocalHeaderSize = 30;
+
+    // `tail` holds the last bytes of the archive
+    static bool findEnd(const char* tail, std::size_t size, End& out);
+    static bool parseZip64End(const char* data, std::size_t size, End& out);
+    // Length of a local header including its name and extra field
+    static bool localHeaderLength(const char* data, std::size_t size, std::uint64_t& length);
+
+    bool parse(const char* data, std::size_t size);
+    const std::vector<ZipEntry>& entries() const;
+
+private:
+    std::vector<ZipEntry> list;
+};
+
+struct TarHeader {
+    std::string name;
+    char type = '\0';
+    std::uint64_t size = 0;
+};
+
+// ustar/GNU/pax header fields
+class TarFormat {
+public:
+    static constexpr std::size_t kBlock = 512;
+
+    // Octal, or base-256 for sizes >= 8 GiB
+    static std::uint64_t parseNumber(const char* p, std::size_t n);
+    static std::uint64_t padding(std::uint64_t size);
+    static bool isEndBlock(const char* block);
+    // False on a checksum mismatch; the name includes the ustar prefix
+    static bool parseHeader(const char* block, TarHeader& out);
+    // path= value of pax extended records, empty if none
+    static std::string paxPath(const std::string& records);
+};
@@ -0,0 +1,196 @@
+#include "ArchiveSink.h"
+#include "FileWriter.h"
+#include "DecompressSink.h"
+#include "TarExtractor.h"
+
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+ArchiveSink::ArchiveSink(const std::string& targetDir, std::vector<ArchiveMember> members, std::size_t decompressBufferLimit)
+    : rootDir(targetDir), entries(std::move(members)), bufferLimit(decompressBufferLimit) {
+}
+
+bool ArchiveSink::open() {
+    byOffset.clear();
+    paths.clear();
+    completed.clear();
+    failed = false;
+    aborted = false;
+    states.assign(entries.size(), MemberState::Waiting);
+    outputs.assign(entries.size(), nullptr);
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const ArchiveMember& m = entries[i];
+        const std::string path = TarExtractor::safeJoin(rootDir, m.name);
+        if (path.empty())
+            return false;
+
+        std::error_code ec;
+        fs::create_directories(fs::path(path).parent_path(), ec);
+        if (ec)
+            return false;
+        paths.push_back(path);
+
+        if (m.storedSize > 0) {
+            byOffset[m.dataOffset] = i;
+            continue;
+        }
+
+        // Nothing will be written for an empty member; create it now
+        auto out = makeOutput(i);
+        if (!out->open() || !out->close())
+            return false;
+        states[i] = MemberState::Done;
+    }
+    return true;
+}
+
+std::unique_ptr<OutputSink> ArchiveSink::makeOutput(std::size_t index) const {
+    const ArchiveMember& m = entries[index];
+    if (m.format == CompressionFormat::None) {
+        // Closed as soon as the member completes, long before the final sync
+        auto file = std::make_unique<FileWriter>(paths[index], m.size);
+        file->setSyncOnClose(true);
+        return file;
+    }
+    return std::make_unique<DecompressSink>(paths[index], m.format, false, nullptr, bufferLimit);
+}
+
+std::shared_ptr<OutputSink> ArchiveSink::output(std::size_t index) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (failed || aborted || states[index] == MemberState::Done)
+        return nullptr;
+
+    if (states[index] == MemberState::Waiting) {
+        std::shared_ptr<OutputSink> out = makeOutput(index);
+        if (!out->open()) {
+            failed = true;
+            return nullptr;
+        }
+        outputs[index] = std::move(out);
+        states[index] = MemberState::Open;
+    }
+    return outputs[index];
+}
+
+bool ArchiveSink::write(std::uint64_t offset, const char* data, std::size_t size) {
+    while (size > 0) {
+        auto it = byOffset.upper_bound(offset);
+        if (it == byOffset.begin())
+            return true;
+        --it;
+
+        const ArchiveMember& m = entries[it->second];
+        const std::uint64_t end = m.dataOffset + m.storedSize;
+        if (offset >= end) {
+            // Between members (coalesced ranges); skip to the next one
+            auto next = std::next(it);
+            if (next == byOffset.end() || next->first >= offset + size)
+                return true;
+            const std::size_t skip = static_cast<std::size_t>(next->first - offset);
+            offset += skip;
+            data += skip;
+            size -= skip;
+            continue;
+        }
+
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(size, end - offset));
+        auto out = output(it->second);
+        if (!out) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (failed || aborted)
+                return false;
+            // Already complete; a repeated range carries nothing new
+        }
+        else if (!out->write(offset - m.dataOffset, data, n)) {
+            return false;
+        }
+        offset += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void ArchiveSink::rangeComplete(std::uint64_t offset, std::uint64_t size) {
+    std::vector<std::shared_ptr<OutputSink>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        completed.add(offset, offset + size);
+
+        auto it = byOffset.upper_bound(offset);
+        if (it != byOffset.begin())
+            --it;
+        for (; it != byOffset.end() && it->first < offset + size; ++it) {
+            const std::size_t i = it->second;
+            const ArchiveMember& m = entries[i];
+            if (states[i] != MemberState::Open || !completed.covers(m.dataOffset, m.dataOffset + m.storedSize))
+                continue;
+            finished.push_back(std::move(outputs[i]));
+            states[i] = MemberState::Done;
+        }
+    }
+
+    // Closing a compressed member waits for its decoder to catch up
+    for (auto& out : finished) {
+        if (!out->close()) {
+            std::lock_guard<std::mutex> lock(mtx);
+            failed = true;
+        }
+    }
+}
+
+std::vector<std::shared_ptr<OutputSink>> ArchiveSink::openOutputs() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<std::shared_ptr<OutputSink>> open;
+    for (auto& out : outputs) {
+        if (out)
+            open.push_back(out);
+    }
+    return open;
+}
+
+void ArchiveSink::flush() {
+    for (auto& out : openOutputs())
+        out->flush();
+}
+
+bool ArchiveSink::drain() {
+    bool ok = true;
+    for (auto& out : openOutputs())
+        ok = out->drain() && ok;
+    std::lock_guard<std::mutex> lock(mtx);
+    return ok && !failed;
+}
+
+bool ArchiveSink::sync() {
+    bool ok = true;
+    for (auto& out : openOutputs())
+        ok = out->sync() && ok;
+    return ok;
+}
+
+void ArchiveSink::abort() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        aborted = true;
+    }
+    for (auto& out : openOutputs())
+        out->abort();
+}
+
+bool ArchiveSink::close() {
+    bool ok = true;
+    for (auto& out : openOutputs())
+        ok = out->close() && ok;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (states[i] != MemberState::Done)
+            ok = false;
+        outputs[i].reset();
+    }
+    return ok && !failed;
+}
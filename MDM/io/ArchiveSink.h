@@ -0,0 +1,52 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "OutputSink.h"
+#include "ArchiveFormat.h"
+#include "../core/RangeSet.h"
+
+// Output for selected members of a remote archive. Writes arrive at archive
+// offsets and are routed to one output per member below targetDir: stored
+// members are written in place, compressed ones go through a streaming
+// decoder. Bytes outside the members are ignored. A member's output is
+// opened by its first write and closed once all its bytes are complete, so
+// only members in flight hold files and decoder threads.
+class ArchiveSink : public OutputSink {
+public:
+    ArchiveSink(const std::string& targetDir, std::vector<ArchiveMember> members, std::size_t decompressBufferLimit);
+
+    bool open() override;
+    bool write(std::uint64_t offset, const char* data, std::size_t size) override;
+    void flush() override;
+    bool drain() override;
+    bool sync() override;
+    void rangeComplete(std::uint64_t offset, std::uint64_t size) override;
+    void abort() override;
+    bool close() override;
+
+private:
+    enum class MemberState { Waiting, Open, Done };
+
+    std::shared_ptr<OutputSink> output(std::size_t index);
+    std::unique_ptr<OutputSink> makeOutput(std::size_t index) const;
+    std::vector<std::shared_ptr<OutputSink>> openOutputs();
+
+private:
+    std::string rootDir;
+    std::vector<ArchiveMember> entries;
+    std::size_t bufferLimit;
+    // dataOffset -> index into entries/outputs
+    std::map<std::uint64_t, std::size_t> byOffset;
+    std::vector<std::string> paths;
+
+    std::mutex mtx;
+    std::vector<MemberState> states;
+    std::vector<std::shared_ptr<OutputSink>> outputs;
+    RangeSet completed;
+    bool failed{ false };
+    bool aborted{ false };
+};
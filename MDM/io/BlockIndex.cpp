@@ -0,0 +1,198 @@
+#include "BlockIndex.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+namespace {
+constexpr std::uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline std::uint64_t rotl(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t read64(const unsigned char* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t read32(const unsigned char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t val) {
+    acc ^= round(0, val);
+    return acc * kPrime1 + kPrime4;
+}
+}
+
+void RollingChecksum::reset(const unsigned char* data, std::size_t len) {
+    a = 0;
+    b = 0;
+    length = len;
+    for (std::size_t i = 0; i < len; ++i) {
+        a += data[i];
+        b += static_cast<std::uint32_t>(len - i) * data[i];
+    }
+    a &= 0xffff;
+    b &= 0xffff;
+}
+
+void RollingChecksum::roll(unsigned char out, unsigned char in) {
+    a = (a - out + in) & 0xffff;
+    b = (b - static_cast<std::uint32_t>(length) * out + a) & 0xffff;
+}
+
+std::uint32_t BlockIndex::weakHash(const unsigned char* data, std::size_t len) {
+    // Plain reduction over the block; unlike the rolling form this has no
+    // byte-to-byte dependency, so the compiler vectorizes it.
+    std::uint32_t a = 0, b = 0;
+    for (std::size_t i = 0; i < len; ++i) {
+        a += data[i];
+        b += static_cast<std::uint32_t>(len - i) * data[i];
+    }
+    return ((b & 0xffff) << 16) | (a & 0xffff);
+}
+
+std::uint64_t BlockIndex::strongHash(const unsigned char* data, std::size_t len) {
+    // XXH64
+    const unsigned char* p = data;
+    const unsigned char* end = data + len;
+    std::uint64_t h;
+
+    if (len >= 32) {
+        std::uint64_t v1 = kPrime1 + kPrime2;
+        std::uint64_t v2 = kPrime2;
+        std::uint64_t v3 = 0;
+        std::uint64_t v4 = 0 - kPrime1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else {
+        h = kPrime5;
+    }
+
+    h += static_cast<std::uint64_t>(len);
+
+    while (p + 8 <= end) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<std::uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool BlockIndex::parse(const std::string& text) {
+    std::istringstream in(text);
+    std::string magic, key;
+    int version = 0;
+
+    if (!(in >> magic >> version) || magic != "mdm-blocks" || version != 1)
+        return false;
+    if (!(in >> key >> blockSize) || key != "blocksize" || blockSize == 0)
+        return false;
+    if (!(in >> key >> fileLength) || key != "length")
+        return false;
+
+    const std::uint64_t count = (fileLength + blockSize - 1) / blockSize;
+    blocks.clear();
+    blocks.reserve(static_cast<std::size_t>(count));
+
+    for (std::uint64_t i = 0; i < count; ++i) {
+        Block blk{};
+        if (!(in >> std::hex >> blk.weak >> blk.strong))
+            return false;
+        blocks.push_back(blk);
+    }
+    return true;
+}
+
+bool BlockIndex::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        return false;
+
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return parse(ss.str());
+}
+
+bool BlockIndex::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    out << "mdm-blocks 1\n"
+        << "blocksize " << blockSize << '\n'
+        << "length " << fileLength << '\n'
+        << std::hex << std::setfill('0');
+
+    for (const auto& blk : blocks)
+        out << std::setw(8) << blk.weak << ' ' << std::setw(16) << blk.strong << '\n';
+
+    return static_cast<bool>(out);
+}
+
+bool BlockIndex::build(const std::string& path, std::uint64_t size) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open() || size == 0)
+        return false;
+
+    blockSize = size;
+    fileLength = 0;
+    blocks.clear();
+
+    std::vector<unsigned char> buf(static_cast<std::size_t>(blockSize));
+    for (;;) {
+        in.read(reinterpret_cast<char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+        const std::size_t n = static_cast<std::size_t>(in.gcount());
+        if (n == 0)
+            break;
+
+        blocks.push_back({ weakHash(buf.data(), n), strongHash(buf.data(), n) });
+        fileLength += n;
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// rsync-style weak checksum that can be rolled forward one byte at a time.
+class RollingChecksum {
+public:
+    void reset(const unsigned char* data, std::size_t len);
+    void roll(unsigned char out, unsigned char in);
+    std::uint32_t value() const { return (b << 16) | (a & 0xffff); }
+
+private:
+    std::uint32_t a{ 0 };
+    std::uint32_t b{ 0 };
+    std::size_t length{ 0 };
+};
+
+// Published list of per-block checksums of a remote file. Text format:
+//   mdm-blocks 1
+//   blocksize <bytes>
+//   length <bytes>
+//   <weak hex> <strong hex>      one line per block
+class BlockIndex {
+public:
+    struct Block {
+        std::uint32_t weak;
+        std::uint64_t strong;
+    };
+
+    std::uint64_t blockSize{ 0 };
+    std::uint64_t fileLength{ 0 };
+    std::vector<Block> blocks;
+
+    bool parse(const std::string& text);
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+    // Compute the index of a local file, e.g. to publish next to it.
+    bool build(const std::string& path, std::uint64_t blockSize);
+
+    static std::uint32_t weakHash(const unsigned char* data, std::size_t len);
+    static std::uint64_t strongHash(const unsigned char* data, std::size_t len);
+};
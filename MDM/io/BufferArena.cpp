@@ -0,0 +1,84 @@
+#include "BufferArena.h"
+
+#include <chrono>
+
+BufferArena::BufferArena(std::size_t bufferSize, std::size_t bufferCount)
+    : size(bufferSize),
+    count(bufferCount == 0 ? 1 : bufferCount),
+    storage(new char[size * count]) {
+    freeList.reserve(count);
+    for (std::size_t i = count; i > 0; --i)
+        freeList.push_back(storage.get() + (i - 1) * size);
+}
+
+void BufferArena::prefault() {
+    constexpr std::size_t kPage = 4096;
+    char* base = storage.get();
+    const std::size_t bytes = size * count;
+    for (std::size_t off = 0; off < bytes; off += kPage)
+        base[off] = 0;
+}
+
+char* BufferArena::acquire() {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    if (freeList.empty() && !closed) {
+        const auto start = std::chrono::steady_clock::now();
+        waits.fetch_add(1, std::memory_order_relaxed);
+        available.wait(lock, [&]() { return !freeList.empty() || closed; });
+        const auto waited = std::chrono::steady_clock::now() - start;
+        waitNanos.fetch_add(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count()),
+            std::memory_order_relaxed);
+    }
+
+    if (closed)
+        return nullptr;
+
+    char* buf = freeList.back();
+    freeList.pop_back();
+
+    const std::size_t inUse = count - freeList.size();
+    if (inUse > peak)
+        peak = inUse;
+    return buf;
+}
+
+void BufferArena::release(char* buffer) {
+    if (!buffer)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        freeList.push_back(buffer);
+    }
+    available.notify_one();
+}
+
+void BufferArena::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+    }
+    available.notify_all();
+}
+
+std::size_t BufferArena::bufferSize() const {
+    return size;
+}
+
+std::size_t BufferArena::bufferCount() const {
+    return count;
+}
+
+std::uint64_t BufferArena::waitCount() const {
+    return waits.load(std::memory_order_relaxed);
+}
+
+double BufferArena::waitSeconds() const {
+    return static_cast<double>(waitNanos.load(std::memory_order_relaxed)) / 1e9;
+}
+
+std::size_t BufferArena::peakInUse() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return peak;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Fixed set of equally sized buffers allocated once up front and recycled.
+// acquire() blocks while all buffers are in flight, which is what bounds
+// memory and pushes back on the network stage.
+class BufferArena {
+public:
+    BufferArena(std::size_t bufferSize, std::size_t bufferCount);
+
+    // Touch every page so the OS backs the arena now, on the NUMA node of
+    // the calling thread (first-touch placement).
+    void prefault();
+
+    char* acquire();
+    void release(char* buffer);
+    // Wake waiters in acquire(); they get nullptr from then on.
+    void shutdown();
+
+    std::size_t bufferSize() const;
+    std::size_t bufferCount() const;
+
+    std::uint64_t waitCount() const;
+    double waitSeconds() const;
+    std::size_t peakInUse() const;
+
+private:
+    std::size_t size;
+    std::size_t count;
+    std::unique_ptr<char[]> storage;
+    std::vector<char*> freeList;
+
+    mutable std::mutex mtx;
+    std::condition_variable available;
+    bool closed{ false };
+
+    std::atomic<std::uint64_t> waits{ 0 };
+    std::atomic<std::uint64_t> waitNanos{ 0 };
+    std::size_t peak{ 0 };
+};
@@ -0,0 +1,19 @@
+#include "CallbackSink.h"
+
+#include <utility>
+
+CallbackSink::CallbackSink(DataCallback cb)
+    : onData(std::move(cb)) {
+}
+
+bool CallbackSink::open() {
+    return static_cast<bool>(onData);
+}
+
+bool CallbackSink::write(std::uint64_t offset, const char* data, std::size_t size) {
+    return onData(offset, data, size);
+}
+
+bool CallbackSink::close() {
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "OutputSink.h"
+
+// Hands every received chunk to the caller. Chunks arrive from several
+// worker threads at once and in no particular order; returning false fails
+// the segment, which is then retried.
+class CallbackSink : public OutputSink
+{
+public:
+    using DataCallback = std::function<bool(std::uint64_t offset, const char* data, std::size_t size)>;
+
+    explicit CallbackSink(DataCallback cb);
+
+    bool open() override;
+    bool write(std::uint64_t offset, const char* data, std::size_t size) override;
+    bool close() override;
+
+private:
+    DataCallback onData;
+};
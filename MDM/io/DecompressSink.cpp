@@ -0,0 +1,179 @@
+#include "DecompressSink.h"
+
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+DecompressSink::DecompressSink(const std::string& outputPath,
+    CompressionFormat format,
+    bool extractTar,
+    std::unique_ptr<OutputSink> compressedCopy,
+    std::size_t bufferLimit)
+    : outPath(outputPath),
+    fmt(format),
+    untar(extractTar),
+    compressedSink(std::move(compressedCopy)),
+    maxBuffered(bufferLimit) {
+}
+
+DecompressSink::~DecompressSink() {
+    abort();
+    if (worker.joinable())
+        worker.join();
+}
+
+bool DecompressSink::open() {
+    decoder = Decompressor::create(fmt);
+    if (!decoder)
+        return false;
+
+    if (compressedSink && !compressedSink->open())
+        return false;
+
+    if (untar) {
+        std::error_code ec;
+        fs::create_directories(outPath, ec);
+        if (ec)
+            return false;
+        extractor = std::make_unique<TarExtractor>(outPath);
+    }
+    else {
+        plainOut.open(outPath, std::ios::binary | std::ios::trunc);
+        if (!plainOut.is_open())
+            return false;
+    }
+
+    worker = std::thread(&DecompressSink::run, this);
+    return true;
+}
+
+bool DecompressSink::write(std::uint64_t offset, const char* data, std::size_t size) {
+    if (compressedSink && !compressedSink->write(offset, data, size))
+        return false;
+
+    std::unique_lock<std::mutex> lock(mtx);
+
+    // A retried range may repeat bytes the decoder already consumed
+    if (offset < frontier) {
+        const std::uint64_t skip = std::min<std::uint64_t>(frontier - offset, size);
+        offset += skip;
+        data += skip;
+        size -= static_cast<std::size_t>(skip);
+        if (size == 0)
+            return true;
+    }
+
+    // The chunk at the frontier is always accepted so the decoder can never
+    // starve while other writers wait for buffer space.
+    spaceFreed.wait(lock, [&]() {
+        return aborted || failed || offset == frontier || bufferedBytes + size <= maxBuffered;
+    });
+    if (aborted || failed)
+        return false;
+
+    auto& slot = pending[offset];
+    if (size > slot.size()) {
+        bufferedBytes += size - slot.size();
+        slot.assign(data, data + size);
+    }
+    lock.unlock();
+
+    dataReady.notify_one();
+    return true;
+}
+
+void DecompressSink::run() {
+    for (;;) {
+        std::vector<char> chunk;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            dataReady.wait(lock, [&]() {
+                return aborted
+                    || inputClosed
+                    || (!pending.empty() && pending.begin()->first <= frontier);
+            });
+
+            if (aborted)
+                return;
+
+            auto it = pending.begin();
+            if (it == pending.end() || it->first > frontier)
+                return; // input closed, nothing more in order
+
+            // Overlapping chunks: only the part past the frontier is new
+            const std::uint64_t skip = frontier - it->first;
+            bufferedBytes -= it->second.size();
+            if (skip < it->second.size()) {
+                chunk.assign(it->second.begin() + static_cast<std::ptrdiff_t>(skip), it->second.end());
+                frontier += chunk.size();
+            }
+            pending.erase(it);
+        }
+        spaceFreed.notify_all();
+        if (chunk.empty())
+            continue;
+
+        if (!decoder->feed(chunk.data(), chunk.size(),
+            [this](const char* d, std::size_t n) { return emit(d, n); })) {
+            std::lock_guard<std::mutex> lock(mtx);
+            failed = true;
+            spaceFreed.notify_all();
+            return;
+        }
+    }
+}
+
+bool DecompressSink::emit(const char* data, std::size_t size) {
+    if (extractor)
+        return extractor->feed(data, size);
+    return static_cast<bool>(plainOut.write(data, size));
+}
+
+void DecompressSink::flush() {
+    if (compressedSink)
+        compressedSink->flush();
+}
+
+bool DecompressSink::sync() {
+    return !compressedSink || compressedSink->sync();
+}
+
+void DecompressSink::abort() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        aborted = true;
+    }
+    dataReady.notify_all();
+    spaceFreed.notify_all();
+}
+
+bool DecompressSink::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        inputClosed = true;
+    }
+    dataReady.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+
+    bool ok = true;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ok = !failed && !aborted && pending.empty();
+    }
+
+    if (decoder && !decoder->finished())
+        ok = false;
+    if (extractor && !extractor->finish())
+        ok = false;
+    if (plainOut.is_open()) {
+        plainOut.close();
+        ok = ok && !plainOut.fail();
+    }
+    if (compressedSink && !compressedSink->close())
+        ok = false;
+
+    return ok;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <string>
+#include <fstream>
+#include <condition_variable>
+
+#include "OutputSink.h"
+#include "Decompressor.h"
+#include "TarExtractor.h"
+
+// Decompresses (and optionally untars) the in-order prefix of the download
+// on its own thread while later segments are still in flight. Out-of-order
+// chunks are held in memory up to `bufferLimit` bytes; beyond that writers
+// ahead of the prefix block until the decoder catches up. The compressed
+// stream is only written to disk when a `compressedCopy` sink is given.
+class DecompressSink : public OutputSink {
+public:
+    DecompressSink(const std::string& outputPath,
+        CompressionFormat format,
+        bool extractTar,
+        std::unique_ptr<OutputSink> compressedCopy,
+        std::size_t bufferLimit);
+    ~DecompressSink() override;
+
+    bool open() override;
+    bool write(std::uint64_t offset, const char* data, std::size_t size) override;
+    void flush() override;
+    bool sync() override;
+    bool close() override;
+    void abort() override;
+
+private:
+    void run();
+    bool emit(const char* data, std::size_t size);
+
+private:
+    std::string outPath;
+    CompressionFormat fmt;
+    bool untar;
+    std::unique_ptr<OutputSink> compressedSink;
+    std::size_t maxBuffered;
+
+    std::unique_ptr<Decompressor> decoder;
+    std::unique_ptr<TarExtractor> extractor;
+    std::ofstream plainOut;
+
+    std::map<std::uint64_t, std::vector<char>> pending;
+    std::size_t bufferedBytes{ 0 };
+    std::uint64_t frontier{ 0 };
+    bool inputClosed{ false };
+    bool aborted{ false };
+    bool failed{ false };
+
+    std::mutex mtx;
+    std::condition_variable dataReady;
+    std::condition_variable spaceFreed;
+    std::thread worker;
+};
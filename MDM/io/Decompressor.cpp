@@ -0,0 +1,182 @@
+#include "Decompressor.h"
+
+#include <vector>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define MDM_HAVE_ZLIB 1
+#endif
+
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define MDM_HAVE_ZSTD 1
+#endif
+
+namespace {
+constexpr std::size_t kOutChunk = 256 * 1024;
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size()
+        && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+class PassThrough : public Decompressor {
+public:
+    bool feed(const char* data, std::size_t size, const OutputFn& out) override {
+        return size == 0 || out(data, size);
+    }
+    bool finished() const override { return true; }
+};
+
+#ifdef MDM_HAVE_ZLIB
+class ZlibDecompressor : public Decompressor {
+public:
+    explicit ZlibDecompressor(bool raw) : buffer(kOutChunk), rawDeflate(raw) {
+        // 15 + 32: auto-detect gzip or zlib header; -15: raw deflate
+        ok = inflateInit2(&strm, raw ? -15 : 15 + 32) == Z_OK;
+    }
+
+    ~ZlibDecompressor() override {
+        if (ok)
+            inflateEnd(&strm);
+    }
+
+    bool feed(const char* data, std::size_t size, const OutputFn& out) override {
+        if (!ok)
+            return false;
+
+        strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        strm.avail_in = static_cast<uInt>(size);
+
+        bool outputFull = false;
+        while (strm.avail_in > 0 || outputFull) {
+            if (done) {
+                // A raw deflate stream (ZIP member) ends for good
+                if (rawDeflate)
+                    return true;
+                // Concatenated gzip members are legal; more input after the
+                // end of one starts the next, even in a later feed
+                if (inflateReset(&strm) != Z_OK)
+                    return false;
+                done = false;
+            }
+
+            strm.next_out = reinterpret_cast<Bytef*>(buffer.data());
+            strm.avail_out = static_cast<uInt>(buffer.size());
+
+            int rc = inflate(&strm, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR)
+                return false;
+
+            const std::size_t produced = buffer.size() - strm.avail_out;
+            if (produced > 0 && !out(buffer.data(), produced))
+                return false;
+            outputFull = strm.avail_out == 0;
+
+            if (rc == Z_STREAM_END) {
+                done = true;
+                outputFull = false;
+            }
+            else if (rc == Z_BUF_ERROR && produced == 0) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool finished() const override { return done; }
+
+private:
+    z_stream strm{};
+    std::vector<char> buffer;
+    bool rawDeflate;
+    bool ok{ false };
+    // At the end of a member; finished unless more input follows
+    bool done{ false };
+};
+#endif
+
+#ifdef MDM_HAVE_ZSTD
+class ZstdDecompressor : public Decompressor {
+public:
+    ZstdDecompressor() : stream(ZSTD_createDStream()), buffer(kOutChunk) {
+        if (stream)
+            ZSTD_initDStream(stream);
+    }
+
+    ~ZstdDecompressor() override {
+        if (stream)
+            ZSTD_freeDStream(stream);
+    }
+
+    bool feed(const char* data, std::size_t size, const OutputFn& out) override {
+        if (!stream)
+            return false;
+
+        ZSTD_inBuffer in{ data, size, 0 };
+        bool outputFull = false;
+        while (in.pos < in.size || outputFull) {
+            ZSTD_outBuffer o{ buffer.data(), buffer.size(), 0 };
+            const std::size_t rc = ZSTD_decompressStream(stream, &o, &in);
+            if (ZSTD_isError(rc))
+                return false;
+            if (o.pos > 0 && !out(buffer.data(), o.pos))
+                return false;
+            outputFull = o.pos == o.size;
+            frameDone = rc == 0;
+        }
+        return true;
+    }
+
+    bool finished() const override { return frameDone; }
+
+private:
+    ZSTD_DStream* stream;
+    std::vector<char> buffer;
+    bool frameDone{ false };
+};
+#endif
+}
+
+std::unique_ptr<Decompressor> Decompressor::create(CompressionFormat format) {
+    switch (format) {
+    case CompressionFormat::None:
+        return std::make_unique<PassThrough>();
+#ifdef MDM_HAVE_ZLIB
+    case CompressionFormat::Gzip:
+        return std::make_unique<ZlibDecompressor>(false);
+    case CompressionFormat::Deflate:
+        return std::make_unique<ZlibDecompressor>(true);
+#endif
+#ifdef MDM_HAVE_ZSTD
+    case CompressionFormat::Zstd:
+        return std::make_unique<ZstdDecompressor>();
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+bool Decompressor::isSupported(CompressionFormat format) {
+    return create(format) != nullptr;
+}
+
+CompressionFormat Decompressor::detect(std::string& name) {
+    if (endsWith(name, ".tgz")) {
+        name.replace(name.size() - 4, 4, ".tar");
+        return CompressionFormat::Gzip;
+    }
+    if (endsWith(name, ".tzst")) {
+        name.replace(name.size() - 5, 5, ".tar");
+        return CompressionFormat::Zstd;
+    }
+    if (endsWith(name, ".gz")) {
+        name.resize(name.size() - 3);
+        return CompressionFormat::Gzip;
+    }
+    if (endsWith(name, ".zst")) {
+        name.resize(name.size() - 4);
+        return CompressionFormat::Zstd;
+    }
+    return CompressionFormat::None;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstddef>
+
+#include "../core/utils.h"
+
+// Incremental decoder: feed compressed bytes in order, decoded bytes are
+// passed to the output callback as they become available.
+class Decompressor {
+public:
+    using OutputFn = std::function<bool(const char*, std::size_t)>;
+
+    virtual ~Decompressor() = default;
+
+    virtual bool feed(const char* data, std::size_t size, const OutputFn& out) = 0;
+    // True once the compressed stream has ended cleanly.
+    virtual bool finished() const = 0;
+
+    // Returns nullptr if the format is not compiled in.
+    static std::unique_ptr<Decompressor> create(CompressionFormat format);
+    static bool isSupported(CompressionFormat format);
+
+    // Guess the format from a file name; strips the compression suffix from
+    // `name` when one is recognized (".tgz" becomes ".tar").
+    static CompressionFormat detect(std::string& name);
+};
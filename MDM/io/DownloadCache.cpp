@@ -0,0 +1,235 @@
+#include "DownloadCache.h"
+#include "BlockIndex.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+const char* kMagic = "mdm-cache";
+const int kVersion = 1;
+const char* kNone = "-";
+
+bool tryLock(int fd) {
+#ifdef _WIN32
+    OVERLAPPED ov{};
+    HANDLE h = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    return LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov) != 0;
+#else
+    return flock(fd, LOCK_EX | LOCK_NB) == 0;
+#endif
+}
+
+bool reflink(const std::string& source, const std::string& target) {
+#if defined(__linux__) && defined(FICLONE)
+    int src = ::open(source.c_str(), O_RDONLY);
+    if (src < 0)
+        return false;
+    int dst = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst < 0) {
+        ::close(src);
+        return false;
+    }
+
+    const bool ok = ioctl(dst, FICLONE, src) == 0;
+    ::close(src);
+    ::close(dst);
+    if (!ok)
+        ::unlink(target.c_str());
+    return ok;
+#else
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+}
+
+DownloadCache::DownloadCache(const std::string& dir)
+    : cacheDir(dir) {
+    std::error_code ec;
+    fs::create_directories(cacheDir, ec);
+}
+
+DownloadCache::~DownloadCache() {
+    unlock();
+}
+
+std::string DownloadCache::keyOf(const std::string& text) const {
+    const std::uint64_t h = BlockIndex::strongHash(
+        reinterpret_cast<const unsigned char*>(text.data()), text.size());
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+}
+
+std::string DownloadCache::entryPath(const std::string& url) const {
+    return (fs::path(cacheDir) / (keyOf(url) + ".entry")).string();
+}
+
+bool DownloadCache::lock(const std::string& url, const std::atomic<bool>& stop) {
+    unlock();
+
+    const std::string path = (fs::path(cacheDir) / (keyOf(url) + ".lock")).string();
+#ifdef _WIN32
+    lockHandle = _open(path.c_str(), _O_RDWR | _O_CREAT, _S_IREAD | _S_IWRITE);
+#else
+    lockHandle = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+    if (lockHandle < 0)
+        return true; // no locking possible, just don't coalesce
+
+    while (!tryLock(lockHandle)) {
+        if (stop.load(std::memory_order_relaxed)) {
+            unlock();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return true;
+}
+
+void DownloadCache::unlock() {
+    if (lockHandle < 0)
+        return;
+
+    // Closing the descriptor drops the lock
+#ifdef _WIN32
+    _close(lockHandle);
+#else
+    ::close(lockHandle);
+#endif
+    lockHandle = -1;
+}
+
+bool DownloadCache::lookup(const std::string& url, CacheEntry& out) const {
+    std::ifstream in(entryPath(url));
+    if (!in.is_open())
+        return false;
+
+    // One field per line: ETags and digests may contain spaces
+    std::string header;
+    std::string size;
+    std::string object;
+    std::getline(in, header);
+    std::getline(in, out.url);
+    std::getline(in, out.etag);
+    std::getline(in, out.digest);
+    std::getline(in, size);
+    std::getline(in, object);
+    if (!in || header != std::string(kMagic) + " " + std::to_string(kVersion) || out.url != url)
+        return false;
+    out.size = std::strtoull(size.c_str(), nullptr, 10);
+    if (out.etag == kNone)
+        out.etag.clear();
+    if (out.digest == kNone)
+        out.digest.clear();
+
+    out.objectPath = (fs::path(cacheDir) / object).string();
+    std::error_code ec;
+    return fs::file_size(out.objectPath, ec) == out.size && !ec;
+}
+
+bool DownloadCache::findByDigest(const std::string& digest, CacheEntry& out) const {
+    if (digest.empty())
+        return false;
+
+    const std::string path = (fs::path(cacheDir) / ("d-" + keyOf(digest))).string();
+    std::error_code ec;
+    const std::uint64_t size = fs::file_size(path, ec);
+    if (ec)
+        return false;
+
+    out.digest = digest;
+    out.size = size;
+    out.objectPath = path;
+    return true;
+}
+
+bool DownloadCache::insert(const std::string& url, const std::string& etag,
+    const std::string& digest, const std::string& path) {
+    // Without a validator the entry could never be revalidated
+    if (etag.empty() && digest.empty())
+        return false;
+
+    std::error_code ec;
+    const std::uint64_t size = fs::file_size(path, ec);
+    if (ec)
+        return false;
+
+    const std::string object = digest.empty()
+        ? "u-" + keyOf(url + "\n" + etag)
+        : "d-" + keyOf(digest);
+    const std::string objectPath = (fs::path(cacheDir) / object).string();
+
+    if (fs::file_size(objectPath, ec) != size || ec) {
+        const std::string tmp = objectPath + ".tmp";
+        fs::remove(tmp, ec);
+        if (!materialize(path, tmp))
+            return false;
+        fs::rename(tmp, objectPath, ec);
+        if (ec) {
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+
+    const std::string entry = entryPath(url);
+    const std::string tmpEntry = entry + ".tmp";
+    {
+        std::FILE* out = std::fopen(tmpEntry.c_str(), "w");
+        if (!out)
+            return false;
+        std::fprintf(out, "%s %d\n%s\n%s\n%s\n%llu\n%s\n",
+            kMagic, kVersion,
+            url.c_str(),
+            etag.empty() ? kNone : etag.c_str(),
+            digest.empty() ? kNone : digest.c_str(),
+            static_cast<unsigned long long>(size),
+            object.c_str());
+        const bool ok = !std::ferror(out);
+        if (std::fclose(out) != 0 || !ok) {
+            fs::remove(tmpEntry, ec);
+            return false;
+        }
+    }
+
+    fs::rename(tmpEntry, entry, ec);
+    return !ec;
+}
+
+bool DownloadCache::materialize(const std::string& source, const std::string& target) {
+    std::error_code ec;
+    fs::remove(target, ec);
+
+    if (reflink(source, target))
+        return true;
+
+    // A hardlink shares the inode: later in-place edits of either name show
+    // up in both, which is fine for downloads that are only read
+    fs::create_hard_link(source, target, ec);
+    if (!ec)
+        return true;
+
+    return fs::copy_file(source, target, fs::copy_options::overwrite_existing, ec) && !ec;
+}
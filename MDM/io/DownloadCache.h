@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+struct CacheEntry {
+    std::string url;
+    std::string etag;
+    std::string digest;
+    std::uint64_t size = 0;
+    std::string objectPath;
+};
+
+// Local cache of completed downloads shared by all jobs on a host. Objects
+// are named by the content digest when the server sends one, otherwise by
+// URL and ETag; a small entry file per URL points at the current object:
+//   mdm-cache 1
+//   <url>
+//   <etag>
+//   <digest or ->
+//   <size>
+//   <object file name>
+class DownloadCache {
+public:
+    explicit DownloadCache(const std::string& dir);
+    ~DownloadCache();
+
+    // Serializes work on one URL across threads and processes, so
+    // concurrent requests wait for the first download instead of repeating
+    // it. Polls so that `stop` can end the wait; false if it did.
+    bool lock(const std::string& url, const std::atomic<bool>& stop);
+    void unlock();
+
+    bool lookup(const std::string& url, CacheEntry& out) const;
+    // Same content published under another URL or ETag
+    bool findByDigest(const std::string& digest, CacheEntry& out) const;
+    // Record a completed download; the object shares `path`'s blocks when
+    // the filesystem allows it
+    bool insert(const std::string& url, const std::string& etag,
+        const std::string& digest, const std::string& path);
+
+    // Reflink, then hardlink, then copy
+    static bool materialize(const std::string& source, const std::string& target);
+
+private:
+    std::string keyOf(const std::string& text) const;
+    std::string entryPath(const std::string& url) const;
+
+private:
+    std::string cacheDir;
+    int lockHandle{ -1 };
+};
@@ -1,20 +1,56 @@
 #include "FileWriter.h"
 
 #include <filesystem>
+#include <vector>
+#include <algorithm>
 
 #ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
 #include <io.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #else
 #include <unistd.h>
 #include <fcntl.h>
+#include <cerrno>
 #endif
 
 namespace fs = std::filesystem;
 
-FileWriter::FileWriter(const std::string& path, std::uint64_t fileSize)
-    : filePath(path), totalSize(fileSize) {
+FileWriter::FileWriter(const std::string& path, std::uint64_t fileSize, bool keepExisting)
+    : filePath(path), totalSize(fileSize), keepExistingFile(keepExisting) {
+}
+
+FileWriter::~FileWriter() {
+    stopEvictor();
+}
+
+void FileWriter::setEarlyWriteback(bool enabled) {
+    earlyWriteback = enabled;
+}
+
+void FileWriter::setSyncOnClose(bool enabled) {
+    syncOnClose = enabled;
+}
+
+void FileWriter::setDropCache(bool enabled, std::uint64_t window) {
+    dropCache = enabled;
+    dropWindow = window;
+}
+
+bool FileWriter::freeSpace(const std::string& path, std::uint64_t& available) {
+    std::error_code ec;
+    fs::path dir = fs::absolute(fs::path(path), ec).parent_path();
+    if (ec)
+        return false;
+
+    const fs::space_info info = fs::space(dir, ec);
+    if (ec)
+        return false;
+
+    available = static_cast<std::uint64_t>(info.available);
+    return true;
 }
 
 bool FileWriter::open() {
@@ -26,46 +62,172 @@ bool FileWriter::open() {
     int mode = 0644;
 #endif
 
-    if (fs::exists(filePath)) {
+    std::error_code ec;
+    const bool resuming = keepExistingFile && fs::exists(filePath, ec)
+        && fs::file_size(filePath, ec) == totalSize;
+
+    if (!resuming && fs::exists(filePath)) {
         fs::remove(filePath);
     }
 
 #ifdef _WIN32
     fileHandle = _open(filePath.c_str(), flags, mode);
 #else
-    fileHandle = open(filePath.c_str(), flags, mode);
+    fileHandle = ::open(filePath.c_str(), flags, mode);
 #endif
 
     if (fileHandle < 0)
         return false;
 
-    // Pre-allocate file size
+#ifdef __linux__
+    if (dropCache) {
+        stopEvicting = false;
+        evictor = std::thread(&FileWriter::evictLoop, this);
+    }
+#endif
+
+    if (resuming || totalSize == 0)
+        return true;
+
+    return preallocate();
+}
+
+bool FileWriter::preallocate() {
 #ifdef _WIN32
-    _lseeki64(fileHandle, totalSize - 1, SEEK_SET);
-    _write(fileHandle, "", 1);
+    return _chsize_s(fileHandle, static_cast<__int64>(totalSize)) == 0;
 #else
-    lseek(fileHandle, totalSize - 1, SEEK_SET);
-    write(fileHandle, "", 1);
+#ifdef __linux__
+    // Reserve real extents up front: no ENOSPC halfway through and far less
+    // fragmentation than a sparse file filled by parallel writers
+    if (fallocate(fileHandle, 0, 0, static_cast<off_t>(totalSize)) == 0)
+        return true;
+    if (errno != EOPNOTSUPP && errno != ENOSYS)
+        return false;
+#endif
+    // No fallocate on this filesystem (posix_fallocate would emulate it by
+    // writing every block), fall back to a sparse file
+    return ftruncate(fileHandle, static_cast<off_t>(totalSize)) == 0;
 #endif
-
-    return true;
 }
 
 bool FileWriter::write(std::uint64_t offset, const char* data, std::size_t size) {
     if (fileHandle < 0)
         return false;
 
-    std::lock_guard<std::mutex> lock(writeMutex);
+    // Positioned writes share no file offset, so writer threads never wait
+    // on each other here
+#ifdef _WIN32
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(fileHandle));
+    while (size > 0) {
+        OVERLAPPED at{};
+        at.Offset = static_cast<DWORD>(offset);
+        at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        const DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1u << 30));
+        DWORD written = 0;
+        if (!WriteFile(handle, data, chunk, &written, &at) || written == 0)
+            return false;
+        offset += written;
+        data += written;
+        size -= written;
+    }
+#else
+    while (size > 0) {
+        const ssize_t n = ::pwrite(fileHandle, data, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        offset += static_cast<std::uint64_t>(n);
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+#endif
+    return true;
+}
 
+int FileWriter::directFd() const {
 #ifdef _WIN32
-    _lseeki64(fileHandle, offset, SEEK_SET);
-    return _write(fileHandle, data, static_cast<unsigned int>(size)) == static_cast<int>(size);
+    return -1;
 #else
-    lseek(fileHandle, offset, SEEK_SET);
-    return ::write(fileHandle, data, size) == static_cast<ssize_t>(size);
+    return fileHandle;
 #endif
 }
 
+bool FileWriter::sync() {
+    if (fileHandle < 0)
+        return false;
+#ifdef _WIN32
+    return _commit(fileHandle) == 0;
+#elif defined(__linux__)
+    return fdatasync(fileHandle) == 0;
+#else
+    return fsync(fileHandle) == 0;
+#endif
+}
+
+void FileWriter::rangeComplete(std::uint64_t offset, std::uint64_t size) {
+#ifdef __linux__
+    if (fileHandle < 0 || size == 0)
+        return;
+
+    if (earlyWriteback || dropCache)
+        sync_file_range(fileHandle, static_cast<off64_t>(offset), static_cast<off64_t>(size), SYNC_FILE_RANGE_WRITE);
+
+    if (!dropCache)
+        return;
+
+    // Ranges leave the window oldest first. Waiting for their writeback can
+    // block on the disk, so that is left to the evictor thread.
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cachedRanges.push_back({ offset, size });
+        cachedBytes += size;
+        if (cachedBytes <= dropWindow)
+            return;
+        while (cachedBytes > dropWindow && !cachedRanges.empty()) {
+            evictQueue.push_back(cachedRanges.front());
+            cachedBytes -= cachedRanges.front().size;
+            cachedRanges.pop_front();
+        }
+    }
+    evictReady.notify_one();
+#else
+    (void)offset;
+    (void)size;
+#endif
+}
+
+void FileWriter::evictLoop() {
+#ifdef __linux__
+    std::unique_lock<std::mutex> lock(cacheMutex);
+    for (;;) {
+        evictReady.wait(lock, [this] { return stopEvicting || !evictQueue.empty(); });
+        if (evictQueue.empty())
+            return;
+
+        const Range r = evictQueue.front();
+        evictQueue.pop_front();
+        lock.unlock();
+        // Writeback was started when the range completed, so this rarely waits long
+        sync_file_range(fileHandle, static_cast<off64_t>(r.offset), static_cast<off64_t>(r.size),
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fileHandle, static_cast<off_t>(r.offset), static_cast<off_t>(r.size), POSIX_FADV_DONTNEED);
+        lock.lock();
+    }
+#endif
+}
+
+void FileWriter::stopEvictor() {
+    if (!evictor.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        stopEvicting = true;
+    }
+    evictReady.notify_one();
+    evictor.join();
+}
+
 void FileWriter::flush() {
 #ifdef _WIN32
     _commit(fileHandle);
@@ -74,13 +236,60 @@ void FileWriter::flush() {
 #endif
 }
 
-void FileWriter::close() {
-    if (fileHandle >= 0) {
+bool FileWriter::close() {
+    if (fileHandle < 0)
+        return true;
+
+    // Queued evictions still use the descriptor
+    stopEvictor();
+
+    // Delayed write errors (NFS, full thin pools) surface here
+    bool ok = !syncOnClose || sync();
 #ifdef _WIN32
-        _close(fileHandle);
+    ok = _close(fileHandle) == 0 && ok;
 #else
-        close(fileHandle);
+    ok = ::close(fileHandle) == 0 && ok;
 #endif
-        fileHandle = -1;
+    fileHandle = -1;
+    return ok;
+}
+
+bool FileWriter::copyRanges(const std::string& srcPath, const std::vector<CopyRange>& ranges) {
+#ifdef __linux__
+    if (fileHandle < 0)
+        return false;
+
+    int src = ::open(srcPath.c_str(), O_RDONLY);
+    if (src < 0)
+        return false;
+
+    // copy_file_range stays in the kernel and shares extents (reflink) on
+    // filesystems that support it when offsets are block aligned
+    bool ok = true;
+    std::size_t i = 0;
+    for (; i < ranges.size() && ok; ++i) {
+        loff_t in = static_cast<loff_t>(ranges[i].srcOffset);
+        loff_t out = static_cast<loff_t>(ranges[i].dstOffset);
+        std::uint64_t left = ranges[i].size;
+
+        while (left > 0) {
+            ssize_t n = copy_file_range(src, &in, fileHandle, &out, static_cast<std::size_t>(left), 0);
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            left -= static_cast<std::uint64_t>(n);
+        }
     }
+    ::close(src);
+
+    if (ok)
+        return true;
+
+    // Cross-device or unsupported: redo the failed range and the rest by hand
+    std::vector<CopyRange> rest(ranges.begin() + static_cast<std::ptrdiff_t>(i - 1), ranges.end());
+    return OutputSink::copyRanges(srcPath, rest);
+#else
+    return OutputSink::copyRanges(srcPath, ranges);
+#endif
 }
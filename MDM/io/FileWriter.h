@@ -2,22 +2,72 @@
 #include <string>
 #include <cstdint>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
 
-class FileWriter
+#include "OutputSink.h"
+
+class FileWriter : public OutputSink
 {
 public:
-    FileWriter(const std::string& path, std::uint64_t fileSize);
+    // keepExisting reopens a partially downloaded file for resume instead
+    // of starting from scratch
+    FileWriter(const std::string& path, std::uint64_t fileSize, bool keepExisting = false);
+    ~FileWriter() override;
+
+    // Start asynchronous writeback of completed ranges so a later sync()
+    // has little left to do
+    void setEarlyWriteback(bool enabled);
+
+    // Write back and drop completed ranges from the page cache, keeping at
+    // most window bytes of finished data cached
+    void setDropCache(bool enabled, std::uint64_t window = 64ull * 1024 * 1024);
+
+    // fdatasync in close(), for files closed before the download ends
+    void setSyncOnClose(bool enabled);
+
+    // Free space on the filesystem that will hold path
+    static bool freeSpace(const std::string& path, std::uint64_t& available);
 
-    bool open();
-    bool write(std::uint64_t offset, const char* data, std::size_t size);
-    void flush();
-    void close();
+    bool open() override;
+    bool write(std::uint64_t offset, const char* data, std::size_t size) override;
+    void flush() override;
+    bool close() override;
+    bool sync() override;
+    void rangeComplete(std::uint64_t offset, std::uint64_t size) override;
+    bool copyRanges(const std::string& srcPath, const std::vector<CopyRange>& ranges) override;
+    int directFd() const override;
 
 private:
     std::string filePath;
     std::uint64_t totalSize;
+    bool keepExistingFile;
+    bool earlyWriteback{ false };
+    bool dropCache{ false };
+    bool syncOnClose{ false };
+    std::uint64_t dropWindow{ 0 };
+
+    bool preallocate();
+
+    struct Range {
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+    std::mutex cacheMutex;
+    std::deque<Range> cachedRanges;
+    std::uint64_t cachedBytes{ 0 };
+
+    // Ranges that left the window wait here for the evictor thread, which
+    // does the blocking writeback and drops them from the page cache
+    std::condition_variable evictReady;
+    std::deque<Range> evictQueue;
+    bool stopEvicting{ false };
+    std::thread evictor;
+
+    void evictLoop();
+    void stopEvictor();
 
-    std::mutex writeMutex;
     int fileHandle = -1;
 };
 
@@ -0,0 +1,23 @@
+#include "MemorySink.h"
+
+#include <cstring>
+
+MemorySink::MemorySink(char* buffer, std::size_t capacity, std::uint64_t fileSize)
+    : base(buffer), bufferCapacity(capacity), totalSize(fileSize) {
+}
+
+bool MemorySink::open() {
+    return totalSize == 0 || (base && totalSize <= bufferCapacity);
+}
+
+bool MemorySink::write(std::uint64_t offset, const char* data, std::size_t size) {
+    if (offset > totalSize || size > totalSize - offset)
+        return false;
+
+    std::memcpy(base + offset, data, size);
+    return true;
+}
+
+bool MemorySink::close() {
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#include "OutputSink.h"
+
+// Writes straight into a caller-owned buffer at the remote offsets, e.g. to
+// load a large object into RAM without touching disk. Workers write
+// disjoint ranges, so no locking is needed.
+class MemorySink : public OutputSink
+{
+public:
+    MemorySink(char* buffer, std::size_t capacity, std::uint64_t fileSize);
+
+    // Fails if the buffer cannot hold the whole object
+    bool open() override;
+    bool write(std::uint64_t offset, const char* data, std::size_t size) override;
+    bool close() override;
+
+private:
+    char* base;
+    std::size_t bufferCapacity;
+    std::uint64_t totalSize;
+};
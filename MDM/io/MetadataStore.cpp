@@ -1,9 +1,52 @@
 #include "MetadataStore.h"
 #include <fstream>
+#include <cstdio>
 #include <filesystem>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
 namespace fs = std::filesystem;
 
+namespace {
+// Tokens are whitespace separated, so an absent ETag needs a placeholder
+const char* kNoEtag = "-";
+// One line per finished range; the old one-line-per-segment layout had no
+// header and is rejected, which just restarts that download
+const char* kMagic = "mdm-resume";
+const int kVersion = 1;
+
+bool syncFile(std::FILE* f) {
+    if (std::fflush(f) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+void syncParentDir(const std::string& path) {
+#ifndef _WIN32
+    // Make the rename itself durable
+    std::string dir = fs::path(path).parent_path().string();
+    if (dir.empty())
+        dir = ".";
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+}
+
 MetadataStore::MetadataStore(const std::string& path) 
 	: metadataPath(path){}
 
@@ -16,52 +59,71 @@ bool MetadataStore::load(DownloadMetadata& out) {
     if (!in.is_open())
         return false;
 
-    std::size_t segmentCount = 0;
+    std::string magic;
+    int version = 0;
+    std::size_t rangeCount = 0;
+
+    in >> magic >> version;
+    if (!in || magic != kMagic || version != kVersion)
+        return false;
 
     in >> out.url;
     in >> out.etag;
     in >> out.fileSize;
     in >> out.completedBytes;
-    in >> segmentCount;
-
-    out.segments.clear();
-    out.segments.reserve(segmentCount);
+    in >> rangeCount;
 
-    for (std::size_t i = 0; i < segmentCount; ++i) {
-        Segment seg{};
-        int state = 0;
+    if (!in)
+        return false;
+    if (out.etag == kNoEtag)
+        out.etag.clear();
 
-        in >> seg.index;
-        in >> seg.offset;
-        in >> seg.size;
-        in >> state;
+    out.done.clear();
+    for (std::size_t i = 0; i < rangeCount; ++i) {
+        std::uint64_t begin = 0;
+        std::uint64_t end = 0;
+        in >> begin >> end;
 
-        seg.state = static_cast<SegmentState>(state);
-        out.segments.push_back(seg);
+        if (!in || begin > end || end > out.fileSize)
+            return false;
+        out.done.add(begin, end);
     }
 
-    return true;
+    return out.done.bytes() == out.completedBytes;
 }
 
-bool MetadataStore::save(const DownloadMetadata& data) {
+bool MetadataStore::save(const DownloadMetadata& data, bool durable) {
     const std::string tmpPath = metadataPath + ".tmp";
 
     {
-        std::ofstream out(tmpPath, std::ios::trunc);
-        if (!out.is_open())
+        std::FILE* out = std::fopen(tmpPath.c_str(), "w");
+        if (!out)
             return false;
 
-        out << data.url << '\n';
-        out << data.etag << '\n';
-        out << data.fileSize << '\n';
-        out << data.completedBytes << '\n';
-        out << data.segments.size() << '\n';
-
-        for (const auto& seg : data.segments) {
-            out << seg.index << ' '
-                << seg.offset << ' '
-                << seg.size << ' '
-                << static_cast<int>(seg.state) << '\n';
+        std::fprintf(out, "%s %d\n%s\n%s\n%llu\n%llu\n%zu\n",
+            kMagic,
+            kVersion,
+            data.url.c_str(),
+            data.etag.empty() ? kNoEtag : data.etag.c_str(),
+            static_cast<unsigned long long>(data.fileSize),
+            static_cast<unsigned long long>(data.completedBytes),
+            data.done.count());
+
+        for (const auto& range : data.done.ranges()) {
+            std::fprintf(out, "%llu %llu\n",
+                static_cast<unsigned long long>(range.first),
+                static_cast<unsigned long long>(range.second));
+        }
+
+        bool ok = !std::ferror(out);
+        if (ok && durable)
+            ok = syncFile(out);
+        if (std::fclose(out) != 0)
+            ok = false;
+
+        if (!ok) {
+            fs::remove(tmpPath);
+            return false;
         }
     }
 
@@ -73,9 +135,17 @@ bool MetadataStore::save(const DownloadMetadata& data) {
         return false;
     }
 
+    if (durable)
+        syncParentDir(metadataPath);
+
     return true;
 }
 
+bool MetadataStore::remove() {
+    std::error_code ec;
+    return fs::remove(metadataPath, ec);
+}
+
 bool MetadataStore::validate(const DownloadMetadata& local,
     const std::string& remoteEtag,
     std::uint64_t remoteFileSize) const {
@@ -86,4 +156,4 @@ bool MetadataStore::validate(const DownloadMetadata& local,
         return false;
 
     return true;
-}
\ No newline at end of file
+}
@@ -6,7 +6,9 @@ public:
     explicit MetadataStore(const std::string& path);
 
     bool load(DownloadMetadata& out);
-    bool save(const DownloadMetadata& data);
+    // durable: fsync the file and its directory before returning
+    bool save(const DownloadMetadata& data, bool durable = false);
+    bool remove();
 
     bool exists() const;
     bool validate(const DownloadMetadata& local,
@@ -0,0 +1,26 @@
+#include "OutputSink.h"
+
+#include <fstream>
+#include <algorithm>
+
+bool OutputSink::copyRanges(const std::string& srcPath, const std::vector<CopyRange>& ranges) {
+    std::ifstream in(srcPath, std::ios::binary);
+    if (!in.is_open())
+        return false;
+
+    std::vector<char> buf(1024 * 1024);
+    for (const auto& r : ranges) {
+        in.seekg(static_cast<std::streamoff>(r.srcOffset));
+
+        std::uint64_t done = 0;
+        while (done < r.size) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(buf.size(), r.size - done));
+            if (!in.read(buf.data(), static_cast<std::streamsize>(n)))
+                return false;
+            if (!write(r.dstOffset + done, buf.data(), n))
+                return false;
+            done += n;
+        }
+    }
+    return true;
+}
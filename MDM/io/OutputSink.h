@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct CopyRange {
+    std::uint64_t srcOffset;
+    std::uint64_t dstOffset;
+    std::uint64_t size;
+};
+
+// Destination for downloaded bytes. Workers write at absolute offsets of the
+// remote object and in no particular order.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    virtual bool open() = 0;
+    virtual bool write(std::uint64_t offset, const char* data, std::size_t size) = 0;
+    virtual void flush() {}
+    // Block until everything the calling thread wrote has reached the
+    // destination; false if any of it failed. Called before a segment is
+    // reported done.
+    virtual bool drain() { return true; }
+    // Make everything written so far durable (fdatasync); used by group
+    // commit before a checkpoint records segments as done.
+    virtual bool sync() { return true; }
+    // Hint that [offset, offset + size) is complete and will not be
+    // written again.
+    virtual void rangeComplete(std::uint64_t offset, std::uint64_t size) { (void)offset; (void)size; }
+    // Unblock any writer waiting inside the sink; used on cancellation.
+    virtual void abort() {}
+    // Returns false if the sink failed after the last successful write.
+    virtual bool close() = 0;
+
+    // File descriptor that bytes may be written to directly at the same
+    // absolute offsets (pwrite, splice), bypassing write(); -1 if the sink
+    // transforms or buffers its data.
+    virtual int directFd() const { return -1; }
+
+    // Fill ranges of the output from a local file. The default reads and
+    // writes through a buffer; file sinks may let the kernel copy or share
+    // extents instead.
+    virtual bool copyRanges(const std::string& srcPath, const std::vector<CopyRange>& ranges);
+};
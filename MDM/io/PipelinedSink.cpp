@@ -0,0 +1,259 @@
+#include "PipelinedSink.h"
+#include "../core/ThreadPlacement.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+std::atomic<std::uint64_t> nextSinkId{ 1 };
+
+struct ThreadBinding {
+    std::uint64_t sinkId{ 0 };
+    void* producer{ nullptr };
+};
+thread_local ThreadBinding binding;
+}
+
+PipelinedSink::PipelinedSink(std::unique_ptr<OutputSink> inner,
+    std::size_t producers,
+    std::size_t writers,
+    std::size_t bufferSize,
+    std::size_t bufferCount)
+    : sink(std::move(inner)),
+    arena(bufferSize, bufferCount),
+    sinkId(nextSinkId.fetch_add(1)) {
+    if (writers == 0)
+        writers = 1;
+
+    for (std::size_t i = 0; i < writers; ++i)
+        writerSlots.push_back(std::make_unique<Writer>());
+
+    // A ring never has to hold more than the whole arena
+    for (std::size_t i = 0; i < producers; ++i) {
+        auto p = std::make_unique<Producer>(arena.bufferCount());
+        p->writer = i % writers;
+        writerSlots[p->writer]->sources.push_back(p.get());
+        producerSlots.push_back(std::move(p));
+    }
+}
+
+PipelinedSink::~PipelinedSink() {
+    abort();
+    stopWriters();
+}
+
+bool PipelinedSink::open() {
+    if (!sink->open())
+        return false;
+
+    for (auto& w : writerSlots)
+        w->thread = std::thread(&PipelinedSink::runWriter, this, std::ref(*w));
+    return true;
+}
+
+PipelinedSink::Producer* PipelinedSink::producerForThread() {
+    if (binding.sinkId == sinkId)
+        return static_cast<Producer*>(binding.producer);
+
+    std::lock_guard<std::mutex> lock(registerMutex);
+    Producer* p = registered < producerSlots.size() ? producerSlots[registered++].get() : nullptr;
+    binding.sinkId = sinkId;
+    binding.producer = p;
+    return p;
+}
+
+bool PipelinedSink::write(std::uint64_t offset, const char* data, std::size_t size) {
+    if (failed.load(std::memory_order_relaxed))
+        return false;
+
+    Producer* p = producerForThread();
+    if (!p)
+        return sink->write(offset, data, size);
+
+    const std::size_t cap = arena.bufferSize();
+    while (size > 0) {
+        // Append to the open buffer while the data stays contiguous
+        if (p->current && (offset != p->currentOffset + p->currentFill || p->currentFill == cap)) {
+            if (!pushCurrent(*p))
+                return false;
+        }
+
+        if (!p->current) {
+            p->current = arena.acquire();
+            if (!p->current)
+                return false;
+            p->currentOffset = offset;
+            p->currentFill = 0;
+        }
+
+        const std::size_t n = std::min(size, cap - p->currentFill);
+        std::memcpy(p->current + p->currentFill, data, n);
+        p->currentFill += n;
+        offset += n;
+        data += n;
+        size -= n;
+    }
+
+    if (p->currentFill == cap)
+        return pushCurrent(*p);
+    return true;
+}
+
+bool PipelinedSink::pushCurrent(Producer& p) {
+    if (!p.current)
+        return true;
+
+    // Cannot fail: the ring holds as many entries as the arena has buffers
+    p.ring.push({ p.current, p.currentOffset, p.currentFill });
+    p.current = nullptr;
+    p.currentFill = 0;
+    p.pushed.fetch_add(1, std::memory_order_release);
+
+    Writer& w = *writerSlots[p.writer];
+    {
+        std::lock_guard<std::mutex> lock(w.mtx);
+        w.signaled = true;
+    }
+    w.cv.notify_one();
+    return !failed.load(std::memory_order_relaxed);
+}
+
+bool PipelinedSink::drain() {
+    Producer* p = producerForThread();
+    if (!p)
+        return !failed.load(std::memory_order_relaxed);
+
+    pushCurrent(*p);
+
+    const std::uint64_t target = p->pushed.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(p->doneMutex);
+    p->doneCv.wait(lock, [&]() {
+        return p->completed.load(std::memory_order_acquire) >= target
+            || stopping.load(std::memory_order_relaxed);
+    });
+
+    return p->completed.load(std::memory_order_acquire) >= target
+        && !failed.load(std::memory_order_relaxed);
+}
+
+void PipelinedSink::runWriter(Writer& w) {
+    if (!writerCpus.empty())
+        ThreadPlacement::pinCurrentThread(writerCpus);
+
+    for (;;) {
+        bool didWork = false;
+
+        for (Producer* p : w.sources) {
+            Item item{};
+            while (p->ring.pop(item)) {
+                didWork = true;
+                if (!failed.load(std::memory_order_relaxed)
+                    && !sink->write(item.offset, item.data, item.size))
+                    failed.store(true, std::memory_order_relaxed);
+
+                arena.release(item.data);
+                written.fetch_add(1, std::memory_order_relaxed);
+
+                {
+                    std::lock_guard<std::mutex> lock(p->doneMutex);
+                    p->completed.fetch_add(1, std::memory_order_release);
+                }
+                p->doneCv.notify_all();
+            }
+        }
+
+        if (didWork)
+            continue;
+
+        std::unique_lock<std::mutex> lock(w.mtx);
+        if (stopping.load(std::memory_order_relaxed)) {
+            // Rings are empty at this point; the producers are gone
+            bool empty = true;
+            for (Producer* p : w.sources)
+                empty = empty && p->ring.empty();
+            if (empty)
+                return;
+            continue;
+        }
+
+        w.cv.wait_for(lock, std::chrono::milliseconds(10), [&]() { return w.signaled; });
+        w.signaled = false;
+    }
+}
+
+void PipelinedSink::stopWriters() {
+    stopping.store(true);
+    for (auto& w : writerSlots) {
+        {
+            std::lock_guard<std::mutex> lock(w->mtx);
+            w->signaled = true;
+        }
+        w->cv.notify_all();
+    }
+    for (auto& p : producerSlots) {
+        std::lock_guard<std::mutex> lock(p->doneMutex);
+        p->doneCv.notify_all();
+    }
+    for (auto& w : writerSlots) {
+        if (w->thread.joinable())
+            w->thread.join();
+    }
+}
+
+void PipelinedSink::flush() {
+    sink->flush();
+}
+
+void PipelinedSink::abort() {
+    // Producers waiting for a buffer give up; data already handed over is
+    // still written, so drain() keeps working for partial segments
+    arena.shutdown();
+    sink->abort();
+}
+
+bool PipelinedSink::close() {
+    // Workers are joined by now; hand over what they left half filled
+    for (auto& p : producerSlots)
+        pushCurrent(*p);
+
+    stopWriters();
+    const bool sinkOk = sink->close();
+    return sinkOk && !failed.load();
+}
+
+bool PipelinedSink::copyRanges(const std::string& srcPath, const std::vector<CopyRange>& ranges) {
+    return sink->copyRanges(srcPath, ranges);
+}
+
+void PipelinedSink::setWriterAffinity(const std::vector<int>& cpus) {
+    writerCpus = cpus;
+}
+
+void PipelinedSink::prefaultBuffers() {
+    arena.prefault();
+}
+
+// Callers drain() before reporting a range, so the inner sink already has
+// every byte these refer to
+bool PipelinedSink::sync() {
+    return sink->sync() && !failed.load();
+}
+
+void PipelinedSink::rangeComplete(std::uint64_t offset, std::uint64_t size) {
+    sink->rangeComplete(offset, size);
+}
+
+int PipelinedSink::directFd() const {
+    return sink->directFd();
+}
+
+PipelinedSink::Stats PipelinedSink::stats() const {
+    return Stats{
+        written.load(std::memory_order_relaxed),
+        arena.waitCount(),
+        arena.waitSeconds(),
+        arena.peakInUse(),
+        arena.bufferCount()
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+#include "OutputSink.h"
+#include "BufferArena.h"
+#include "SpscRing.h"
+
+// Decouples network receive from disk writes. Each producer thread copies
+// incoming data into arena buffers and hands full buffers to a writer
+// thread over its own SPSC ring, so a slow write never stalls a socket.
+// Producers are registered on their first write; threads beyond
+// `producers` fall back to writing through directly.
+class PipelinedSink : public OutputSink {
+public:
+    struct Stats {
+        std::uint64_t buffersWritten;
+        std::uint64_t arenaWaits;      // producer found no free buffer
+        double arenaWaitSeconds;
+        std::size_t peakBuffersInUse;
+        std::size_t bufferCount;
+    };
+
+    PipelinedSink(std::unique_ptr<OutputSink> inner,
+        std::size_t producers,
+        std::size_t writers,
+        std::size_t bufferSize,
+        std::size_t bufferCount);
+    ~PipelinedSink() override;
+
+    bool open() override;
+    bool write(std::uint64_t offset, const char* data, std::size_t size) override;
+    bool drain() override;
+    void flush() override;
+    void abort() override;
+    bool close() override;
+    bool copyRanges(const std::string& srcPath, const std::vector<CopyRange>& ranges) override;
+    bool sync() override;
+    void rangeComplete(std::uint64_t offset, std::uint64_t size) override;
+    // Ranges are disjoint, so direct writes need no ordering with the queue
+    int directFd() const override;
+
+    Stats stats() const;
+
+    // Both must be called before open()
+    void setWriterAffinity(const std::vector<int>& cpus);
+    void prefaultBuffers();
+
+private:
+    struct Item {
+        char* data;
+        std::uint64_t offset;
+        std::size_t size;
+    };
+
+    struct Producer {
+        explicit Producer(std::size_t capacity) : ring(capacity) {}
+
+        SpscRing<Item> ring;
+        std::size_t writer{ 0 };
+
+        // Buffer being filled; only touched by the owning thread
+        char* current{ nullptr };
+        std::uint64_t currentOffset{ 0 };
+        std::size_t currentFill{ 0 };
+
+        std::atomic<std::uint64_t> pushed{ 0 };
+        std::atomic<std::uint64_t> completed{ 0 };
+        std::mutex doneMutex;
+        std::condition_variable doneCv;
+    };
+
+    struct Writer {
+        std::thread thread;
+        std::vector<Producer*> sources;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool signaled{ false };
+    };
+
+    Producer* producerForThread();
+    bool pushCurrent(Producer& p);
+    void runWriter(Writer& w);
+    void stopWriters();
+
+private:
+    std::unique_ptr<OutputSink> sink;
+    BufferArena arena;
+    std::vector<std::unique_ptr<Producer>> producerSlots;
+    std::vector<std::unique_ptr<Writer>> writerSlots;
+    std::vector<int> writerCpus;
+
+    const std::uint64_t sinkId;
+    std::mutex registerMutex;
+    std::size_t registered{ 0 };
+
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> failed{ false };
+    std::atomic<std::uint64_t> written{ 0 };
+};
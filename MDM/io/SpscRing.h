@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer ring. Storage is allocated once;
+// push/pop never allocate or lock.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t capacity)
+        : slots(capacity + 1) {
+    }
+
+    bool push(const T& item) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        const std::size_t next = (t + 1) % slots.size();
+        if (next == head.load(std::memory_order_acquire))
+            return false;
+        slots[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& out) {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        out = slots[h];
+        head.store((h + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots;
+    alignas(64) std::atomic<std::size_t> head{ 0 };
+    alignas(64) std::atomic<std::size_t> tail{ 0 };
+};
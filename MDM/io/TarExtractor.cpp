@@ -0,0 +1,171 @@
+#include "TarExtractor.h"
+#include "ArchiveFormat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::size_t kBlock = TarFormat::kBlock;
+}
+
+TarExtractor::TarExtractor(const std::string& targetDir)
+    : rootDir(targetDir) {
+}
+
+bool TarExtractor::feed(const char* data, std::size_t size) {
+    while (size > 0 && !failed) {
+        if (bodyRemaining > 0) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(bodyRemaining, size));
+            if (capture != Capture::None)
+                captured.append(data, n);
+            else if (current.is_open() && !current.write(data, n))
+                failed = true;
+
+            bodyRemaining -= n;
+            data += n;
+            size -= n;
+
+            if (bodyRemaining == 0) {
+                if (capture != Capture::None)
+                    applyCaptured();
+                if (current.is_open())
+                    current.close();
+            }
+            continue;
+        }
+
+        if (paddingRemaining > 0) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(paddingRemaining, size));
+            paddingRemaining -= n;
+            data += n;
+            size -= n;
+            continue;
+        }
+
+        if (endOfArchive) {
+            // Trailing zero blocks and record padding
+            return true;
+        }
+
+        const std::size_t n = std::min(kBlock - headerFill, size);
+        std::memcpy(header + headerFill, data, n);
+        headerFill += n;
+        data += n;
+        size -= n;
+
+        if (headerFill == kBlock) {
+            headerFill = 0;
+            if (!onHeader())
+                failed = true;
+        }
+    }
+    return !failed;
+}
+
+bool TarExtractor::onHeader() {
+    if (TarFormat::isEndBlock(header)) {
+        endOfArchive = true;
+        return true;
+    }
+
+    TarHeader h;
+    if (!TarFormat::parseHeader(header, h))
+        return false;
+
+    const char type = h.type;
+    const std::uint64_t size = h.size;
+
+    std::string name = h.name;
+    if (!pendingName.empty()) {
+        name = pendingName;
+        pendingName.clear();
+    }
+
+    bodyRemaining = size;
+    paddingRemaining = TarFormat::padding(size);
+    capture = Capture::None;
+
+    if (type == 'L') {
+        capture = Capture::LongName;
+        captured.clear();
+    }
+    else if (type == 'x') {
+        capture = Capture::Pax;
+        captured.clear();
+    }
+    else if (!beginMember(name, type)) {
+        return false;
+    }
+
+    if (bodyRemaining == 0) {
+        if (capture != Capture::None)
+            applyCaptured();
+        current.close();
+    }
+    return true;
+}
+
+void TarExtractor::applyCaptured() {
+    if (capture == Capture::LongName) {
+        pendingName = captured.substr(0, strnlen(captured.data(), captured.size()));
+    }
+    else {
+        const std::string path = TarFormat::paxPath(captured);
+        if (!path.empty())
+            pendingName = path;
+    }
+    captured.clear();
+    capture = Capture::None;
+}
+
+bool TarExtractor::beginMember(const std::string& name, char type) {
+    const std::string path = safePath(name);
+    if (path.empty())
+        return true; // skip unsafe entries, but keep going
+
+    std::error_code ec;
+    if (type == '5') {
+        fs::create_directories(path, ec);
+        return !ec;
+    }
+
+    if (type != '0' && type != '\0' && type != '7')
+        return true;
+
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    current.open(path, std::ios::binary | std::ios::trunc);
+    if (!current.is_open())
+        return false;
+
+    ++files;
+    return true;
+}
+
+std::string TarExtractor::safePath(const std::string& name) const {
+    return safeJoin(rootDir, name);
+}
+
+std::string TarExtractor::safeJoin(const std::string& root, const std::string& name) {
+    fs::path rel(name);
+    if (rel.empty() || rel.is_absolute() || rel.has_root_name())
+        return {};
+    for (const auto& part : rel) {
+        if (part == "..")
+            return {};
+    }
+    return (fs::path(root) / rel).lexically_normal().string();
+}
+
+bool TarExtractor::finish() {
+    if (current.is_open())
+        current.close();
+    return !failed && bodyRemaining == 0 && headerFill == 0;
+}
+
+std::size_t TarExtractor::extractedFiles() const {
+    return files;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+// Streaming ustar/GNU/pax reader that writes members below a target
+// directory as bytes arrive. Only regular files and directories are
+// materialized; links and special files are skipped.
+class TarExtractor {
+public:
+    explicit TarExtractor(const std::string& targetDir);
+
+    bool feed(const char* data, std::size_t size);
+    // True when the archive ended on a member boundary.
+    bool finish();
+
+    std::size_t extractedFiles() const;
+
+    // root/name, or empty if name is absolute or climbs out of root
+    static std::string safeJoin(const std::string& root, const std::string& name);
+
+private:
+    bool onHeader();
+    bool beginMember(const std::string& name, char type);
+    void applyCaptured();
+    std::string safePath(const std::string& name) const;
+
+private:
+    std::string rootDir;
+
+    char header[512];
+    std::size_t headerFill{ 0 };
+
+    std::uint64_t bodyRemaining{ 0 };
+    std::uint64_t paddingRemaining{ 0 };
+
+    // GNU 'L' / pax 'x' records are collected in memory, then applied to the
+    // next header.
+    enum class Capture { None, LongName, Pax } capture{ Capture::None };
+    std::string captured;
+    std::string pendingName;
+
+    std::ofstream current;
+    std::size_t files{ 0 };
+    bool endOfArchive{ false };
+    bool failed{ false };
+};
@@ -0,0 +1,53 @@
+#include "WatermarkFile.h"
+#include <cstdio>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace {
+const char* kMagic = "mdm-prefix";
+const int kVersion = 1;
+}
+
+WatermarkFile::WatermarkFile(const std::string& path)
+    : sidecarPath(path) {
+}
+
+bool WatermarkFile::publish(std::uint64_t prefix, std::uint64_t total) {
+    if (written && prefix == published)
+        return true;
+
+    // Readers must never see a torn value, so write aside and rename over
+    const std::string tmpPath = sidecarPath + ".tmp";
+    std::FILE* out = std::fopen(tmpPath.c_str(), "w");
+    if (!out)
+        return false;
+
+    std::fprintf(out, "%s %d\n%llu %llu\n",
+        kMagic,
+        kVersion,
+        static_cast<unsigned long long>(prefix),
+        static_cast<unsigned long long>(total));
+
+    std::error_code ec;
+    const bool ok = !std::ferror(out);
+    if (std::fclose(out) != 0 || !ok) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+
+    fs::rename(tmpPath, sidecarPath, ec);
+    if (ec) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+
+    published = prefix;
+    written = true;
+    return true;
+}
+
+bool WatermarkFile::remove() {
+    std::error_code ec;
+    return fs::remove(sidecarPath, ec);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// Sidecar publishing how many bytes from the start of the output are
+// complete, for readers that consume the file while it downloads. The
+// file is replaced atomically and holds
+//   mdm-prefix 1
+//   <prefix bytes> <total bytes>
+// It is removed once the download completes.
+class WatermarkFile {
+public:
+    explicit WatermarkFile(const std::string& path);
+
+    // Rewrites the sidecar only when the prefix moved
+    bool publish(std::uint64_t prefix, std::uint64_t total);
+    bool remove();
+
+private:
+    std::string sidecarPath;
+    std::uint64_t published{ 0 };
+    bool written{ false };
+};
@@ -2,16 +2,64 @@
 #include <chrono>
 #include <thread>
 #include <csignal>
+#include <cstdlib>
+#include <atomic>
 #include "cli/ArgumentParser.h"
 #include "core/DownloadController.h"
+#include "core/DownloadDaemon.h"
+#include "io/BlockIndex.h"
+#include "net/ControlSocket.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#endif
 using namespace std;
 
 namespace {
 volatile std::sig_atomic_t gStopRequested = 0;
+std::atomic<DownloadController*> gController{ nullptr };
 
-void handleSignal(int) {
+void handleSignal(int sig) {
+    // A second Ctrl-C while shutdown is still running: leave right away
+    if (gStopRequested)
+        std::_Exit(128 + sig);
     gStopRequested = 1;
+#ifdef _WIN32
+    // Windows runs console signal handlers on their own thread
+    if (auto* controller = gController.load())
+        controller->requestStop();
+#endif
+}
+
+#ifndef _WIN32
+// Take SIGINT/SIGTERM synchronously on a dedicated thread so the controller
+// can be woken directly instead of polling a flag. The first signal asks
+// for a clean stop; a second one, e.g. during a slow shutdown, exits at once.
+void startSignalWatcher() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+    std::thread([set]() {
+        for (;;) {
+            int sig = 0;
+            if (sigwait(&set, &sig) != 0)
+                continue;
+            if (gStopRequested) {
+                std::cerr << "\nInterrupted again, exiting without cleanup\n";
+                std::_Exit(128 + sig);
+            }
+            gStopRequested = 1;
+            std::cerr << "\nStopping, press Ctrl-C again to exit immediately\n";
+            if (auto* controller = gController.load())
+                controller->requestStop();
+        }
+        }).detach();
 }
+#endif
 }
 
 int main(int argc, char* argv[]) {
@@ -24,8 +72,48 @@ int main(int argc, char* argv[]) {
     if (!parser.parse(argc, argv, config))
         return 1;
 
+    if (!parser.makeIndexPath.empty()) {
+        BlockIndex index;
+        const std::string out = parser.makeIndexPath + ".mdmidx";
+        if (!index.build(parser.makeIndexPath, parser.indexBlockSize) || !index.save(out)) {
+            std::cerr << "Cannot build index for " << parser.makeIndexPath << "\n";
+            return 1;
+        }
+        std::cout << "Wrote " << out << " (" << index.blocks.size() << " blocks)\n";
+        return 0;
+    }
+
+    if (!parser.controlSocket.empty()) {
+        std::string reply;
+        if (!ControlSocket::request(parser.controlSocket, parser.controlCommand, reply)) {
+            std::cerr << "Cannot reach daemon at " << parser.controlSocket << "\n";
+            return 1;
+        }
+        std::cout << reply << "\n";
+        return reply.compare(0, 5, "error") == 0 ? 1 : 0;
+    }
+
+    if (!parser.daemonSocket.empty()) {
+        DownloadDaemon::Options options;
+        options.socketPath = parser.daemonSocket;
+        options.connections = parser.daemonConnections;
+        options.bytesPerSec = parser.daemonBytesPerSec;
+        options.maxActive = parser.daemonJobs;
+
+        DownloadDaemon daemon(options);
+#ifndef _WIN32
+        startSignalWatcher();
+#endif
+        return daemon.run(&gStopRequested) ? 0 : 1;
+    }
+
     DownloadController controller(config, &gStopRequested);
+    gController = &controller;
+#ifndef _WIN32
+    startSignalWatcher();
+#endif
     controller.start();
+    gController = nullptr;
 
     return 0;
 }
@@ -1,12 +1,22 @@
 #include "Logger.h"
 #include <iostream>
 
+#include "../core/ThreadPlacement.h"
+
 Logger::Logger() {}
 
 Logger::~Logger() {
     stop();
 }
 
+void Logger::setAffinity(const std::vector<int>& cpus) {
+    affinity = cpus;
+}
+
+void Logger::setHandler(std::function<void(const std::string&)> handler) {
+    output = std::move(handler);
+}
+
 void Logger::start() {
     running.store(true);
     worker = std::thread(&Logger::run, this);
@@ -29,6 +39,9 @@ void Logger::log(const std::string& msg) {
 }
 
 void Logger::run() {
+    if (!affinity.empty())
+        ThreadPlacement::pinCurrentThread(affinity);
+
     while (running.load() || !messages.empty()) {
         std::unique_lock<std::mutex> lock(mtx);
         cv.wait(lock, [&]() {
@@ -36,7 +49,10 @@ void Logger::run() {
             });
 
         while (!messages.empty()) {
-            std::cout << messages.front() << std::endl;
+            if (output)
+                output(messages.front());
+            else
+                std::cout << messages.front() << std::endl;
             messages.pop();
         }
     }
@@ -5,12 +5,18 @@
 #include <thread>
 #include <condition_variable>
 #include <atomic>
+#include <vector>
+#include <functional>
 
 class Logger {
 public:
     Logger();
     ~Logger();
 
+    // Must be called before start()
+    void setAffinity(const std::vector<int>& cpus);
+    // Send lines here instead of stdout; must be called before start()
+    void setHandler(std::function<void(const std::string&)> handler);
     void start();
     void stop();
     void log(const std::string& msg);
@@ -24,4 +30,6 @@ private:
     std::condition_variable cv;
     std::atomic<bool> running{ false };
     std::thread worker;
+    std::vector<int> affinity;
+    std::function<void(const std::string&)> output;
 };
@@ -1,31 +1,130 @@
 #include "ProgressTracker.h"
 
-ProgressTracker::ProgressTracker(std::uint64_t totalBytes)
-    : total(totalBytes),
-    start(std::chrono::steady_clock::now()) {
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Time constant of the throughput EWMA; a few seconds smooths out
+// per-segment bursts without hiding real rate changes.
+constexpr double kRateTimeConstantSec = 5.0;
+// The ETA is smoothed separately so it does not jitter every tick.
+constexpr double kEtaTimeConstantSec = 3.0;
+}
+
+ProgressTracker::ProgressTracker(std::uint64_t totalBytes, std::size_t slotCount) {
+    reset(totalBytes, slotCount);
+}
+
+void ProgressTracker::add(std::size_t slot, std::uint64_t bytes) {
+    if (slot >= slots)
+        slot = 0;
+    counters[slot].bytes.fetch_add(bytes, std::memory_order_relaxed);
 }
 
 void ProgressTracker::add(std::uint64_t bytes) {
-    current.fetch_add(bytes, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(sampleMutex);
+    baseBytes.fetch_add(bytes, std::memory_order_relaxed);
+    lastSampleBytes += bytes;
+}
+
+void ProgressTracker::rollback(std::size_t slot, std::uint64_t bytes) {
+    if (slot >= slots)
+        slot = 0;
+    counters[slot].bytes.fetch_sub(bytes, std::memory_order_relaxed);
 }
 
 std::uint64_t ProgressTracker::downloaded() const {
-    return current.load(std::memory_order_relaxed);
+    std::uint64_t sum = baseBytes.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < slots; ++i)
+        sum += counters[i].bytes.load(std::memory_order_relaxed);
+    return sum;
+}
+
+std::uint64_t ProgressTracker::total() const {
+    return totalSize.load(std::memory_order_relaxed);
 }
 
 double ProgressTracker::progress() const {
-    return total == 0 ? 0.0 : (double)downloaded() / (double)total;
+    const auto t = total();
+    return t == 0 ? 0.0 : (double)downloaded() / (double)t;
 }
 
 double ProgressTracker::speedBytesPerSec() const {
-    auto now = std::chrono::steady_clock::now();
-    std::chrono::duration<double> elapsed = now - start;
-    return elapsed.count() > 0 ? downloaded() / elapsed.count() : 0.0;
+    return ewmaRate.load(std::memory_order_relaxed);
+}
+
+double ProgressTracker::etaSeconds() const {
+    return eta.load(std::memory_order_relaxed);
+}
+
+double ProgressTracker::connectionBytesPerSec(std::size_t slot) const {
+    if (slot >= slots)
+        return 0.0;
+    return counters[slot].rate.load(std::memory_order_relaxed);
+}
+
+std::size_t ProgressTracker::slotCount() const {
+    return slots;
 }
 
-void ProgressTracker::reset(std::uint64_t totalBytes) {
-    total = totalBytes;
-    current.store(0, std::memory_order_relaxed);
-    start = std::chrono::steady_clock::now();
+void ProgressTracker::sample() {
+    std::lock_guard<std::mutex> lock(sampleMutex);
+
+    const auto now = std::chrono::steady_clock::now();
+    const double dt = std::chrono::duration<double>(now - lastSample).count();
+    if (dt <= 0.0)
+        return;
+
+    for (std::size_t i = 0; i < slots; ++i) {
+        auto& s = counters[i];
+        const std::uint64_t cur = s.bytes.load(std::memory_order_relaxed);
+        const double delta = cur >= s.lastBytes ? static_cast<double>(cur - s.lastBytes) : 0.0;
+        s.rate.store(delta / dt, std::memory_order_relaxed);
+        s.lastBytes = cur;
+    }
+
+    const std::uint64_t cur = downloaded();
+    const double instant = cur >= lastSampleBytes
+        ? static_cast<double>(cur - lastSampleBytes) / dt
+        : 0.0;
+    lastSampleBytes = cur;
+    lastSample = now;
+
+    // Time-aware EWMA: irregular sample intervals weigh proportionally.
+    double rate = ewmaRate.load(std::memory_order_relaxed);
+    const double alpha = 1.0 - std::exp(-dt / kRateTimeConstantSec);
+    rate = rate <= 0.0 ? instant : rate + alpha * (instant - rate);
+    ewmaRate.store(rate, std::memory_order_relaxed);
+
+    const std::uint64_t t = total();
+    const std::uint64_t remaining = t > cur ? t - cur : 0;
+    double nextEta = -1.0;
+    if (remaining == 0) {
+        nextEta = 0.0;
+    }
+    else if (rate > 0.0) {
+        const double raw = static_cast<double>(remaining) / rate;
+        const double prev = eta.load(std::memory_order_relaxed);
+        const double beta = 1.0 - std::exp(-dt / kEtaTimeConstantSec);
+        // Let the ETA follow the wall clock between samples, then blend.
+        nextEta = prev < 0.0 ? raw : std::max(0.0, prev - dt) + beta * (raw - std::max(0.0, prev - dt));
+    }
+    eta.store(nextEta, std::memory_order_relaxed);
 }
 
+void ProgressTracker::reset(std::uint64_t totalBytes, std::size_t slotCount) {
+    std::lock_guard<std::mutex> lock(sampleMutex);
+
+    if (slotCount == 0)
+        slotCount = 1;
+
+    totalSize.store(totalBytes, std::memory_order_relaxed);
+    slots = slotCount;
+    counters = std::make_unique<Slot[]>(slots);
+    baseBytes.store(0, std::memory_order_relaxed);
+
+    lastSample = std::chrono::steady_clock::now();
+    lastSampleBytes = 0;
+    ewmaRate.store(0.0, std::memory_order_relaxed);
+    eta.store(-1.0, std::memory_order_relaxed);
+}
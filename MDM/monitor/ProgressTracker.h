@@ -1,20 +1,59 @@
 #pragma once
 #include <atomic>
 #include <cstdint>
+#include <cstddef>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 
+// Per-worker byte counters live on their own cache line so chunk-granular
+// updates from different threads never contend. Readers aggregate lock-free.
 class ProgressTracker {
 public:
-    explicit ProgressTracker(std::uint64_t totalBytes);
+    explicit ProgressTracker(std::uint64_t totalBytes, std::size_t slotCount = 1);
 
+    // Hot path: called from worker write callbacks for every chunk.
+    void add(std::size_t slot, std::uint64_t bytes);
+    // Bytes that were already present (reused or resumed); they count towards
+    // progress but not towards throughput.
     void add(std::uint64_t bytes);
+    // Undo bytes that were counted for a segment that later failed.
+    void rollback(std::size_t slot, std::uint64_t bytes);
+
     std::uint64_t downloaded() const;
+    std::uint64_t total() const;
     double progress() const;
+
+    // Smoothed (EWMA) throughput, updated by sample().
     double speedBytesPerSec() const;
-    void reset(std::uint64_t totalBytes);
+    // Seconds left at the smoothed rate, negative if unknown.
+    double etaSeconds() const;
+    // Rate of a single worker slot over the last sample interval.
+    double connectionBytesPerSec(std::size_t slot) const;
+    std::size_t slotCount() const;
+
+    // Called periodically by a single owner (the controller loop) to
+    // advance the sliding window; readers never take a lock.
+    void sample();
+
+    void reset(std::uint64_t totalBytes, std::size_t slotCount = 1);
 
 private:
-    std::uint64_t total;
-    std::atomic<std::uint64_t> current{ 0 };
-    std::chrono::steady_clock::time_point start;
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> bytes{ 0 };
+        std::atomic<double> rate{ 0.0 };
+        std::uint64_t lastBytes{ 0 };
+    };
+
+    std::atomic<std::uint64_t> totalSize{ 0 };
+    std::size_t slots{ 0 };
+    std::unique_ptr<Slot[]> counters;
+    std::atomic<std::uint64_t> baseBytes{ 0 };
+
+    std::chrono::steady_clock::time_point lastSample;
+    std::uint64_t lastSampleBytes{ 0 };
+    std::atomic<double> ewmaRate{ 0.0 };
+    std::atomic<double> eta{ -1.0 };
+    std::mutex sampleMutex;
 };
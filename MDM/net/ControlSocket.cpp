@@ -0,0 +1,194 @@
+#include "ControlSocket.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+namespace {
+constexpr int kPollMs = 200;
+// Clients are served one at a time, so none may hold the loop for long:
+// each command must arrive within this time, and replies must be read
+constexpr auto kClientIdle = std::chrono::seconds(2);
+constexpr int kSendTimeoutSec = 2;
+constexpr int kReplyTimeoutSec = 30;
+constexpr std::size_t kMaxLine = 64 * 1024;
+const char* kTerminator = "\n.\n";
+
+#ifndef _WIN32
+bool makeAddress(const std::string& path, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+bool sendAll(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+#endif
+}
+
+ControlSocket::ControlSocket(const std::string& path)
+    : socketPath(path) {
+}
+
+ControlSocket::~ControlSocket() {
+#ifndef _WIN32
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+    }
+#endif
+}
+
+#ifndef _WIN32
+
+bool ControlSocket::listen() {
+    sockaddr_un addr;
+    if (!makeAddress(socketPath, addr))
+        return false;
+
+    // A socket nobody accepts on is left over from a crash
+    const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        const bool live = ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        ::close(probe);
+        if (live)
+            return false;
+    }
+    ::unlink(socketPath.c_str());
+
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+        return false;
+
+    // Only the owner may submit downloads
+    const mode_t old = ::umask(077);
+    const bool bound = ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    ::umask(old);
+
+    if (!bound || ::listen(listener, 16) != 0) {
+        ::close(listener);
+        listener = -1;
+        return false;
+    }
+    return true;
+}
+
+void ControlSocket::serve(const Handler& handler, const std::atomic<bool>& stop) {
+    while (!stop.load(std::memory_order_relaxed)) {
+        pollfd p{ listener, POLLIN, 0 };
+        if (::poll(&p, 1, kPollMs) <= 0)
+            continue;
+
+        const int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+        timeval tv{ kSendTimeoutSec, 0 };
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        serveClient(client, handler, stop);
+        ::close(client);
+    }
+}
+
+void ControlSocket::serveClient(int client, const Handler& handler, const std::atomic<bool>& stop) {
+    std::string pending;
+    char buf[4096];
+    auto deadline = std::chrono::steady_clock::now() + kClientIdle;
+    while (!stop.load(std::memory_order_relaxed)) {
+        std::size_t nl;
+        while ((nl = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, nl);
+            pending.erase(0, nl + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!sendAll(client, handler(line) + kTerminator))
+                return;
+            deadline = std::chrono::steady_clock::now() + kClientIdle;
+        }
+        if (pending.size() > kMaxLine)
+            return;
+
+        // Silent or trickling clients are dropped so the next one is heard
+        if (std::chrono::steady_clock::now() >= deadline)
+            return;
+
+        pollfd p{ client, POLLIN, 0 };
+        const int r = ::poll(&p, 1, kPollMs);
+        if (r == 0)
+            continue;
+        if (r < 0)
+            return;
+        const ssize_t n = ::recv(client, buf, sizeof(buf), 0);
+        if (n <= 0)
+            return;
+        pending.append(buf, static_cast<std::size_t>(n));
+    }
+}
+
+bool ControlSocket::request(const std::string& path, const std::string& line, std::string& reply) {
+    sockaddr_un addr;
+    if (!makeAddress(path, addr))
+        return false;
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    timeval tv{ kReplyTimeoutSec, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || !sendAll(fd, line + "\n")) {
+        ::close(fd);
+        return false;
+    }
+
+    reply.clear();
+    char buf[4096];
+    bool ok = false;
+    for (;;) {
+        const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        reply.append(buf, static_cast<std::size_t>(n));
+        if (reply.size() >= 3 && reply.compare(reply.size() - 3, 3, kTerminator) == 0) {
+            reply.resize(reply.size() - 3);
+            ok = true;
+            break;
+        }
+    }
+    ::close(fd);
+    return ok;
+}
+
+#else
+
+bool ControlSocket::listen() {
+    return false;
+}
+
+void ControlSocket::serve(const Handler&, const std::atomic<bool>&) {
+}
+
+void ControlSocket::serveClient(int, const Handler&, const std::atomic<bool>&) {
+}
+
+bool ControlSocket::request(const std::string&, const std::string&, std::string&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <functional>
+
+// Line-based control channel on a Unix-domain socket. Clients send one
+// command per line; each reply is the handler's text followed by a line
+// holding a single ".". Clients are served one at a time, which is plenty
+// for short control requests; a client that goes quiet mid-command is
+// dropped after a short idle timeout. Not available on Windows.
+class ControlSocket {
+public:
+    using Handler = std::function<std::string(const std::string& line)>;
+
+    explicit ControlSocket(const std::string& path);
+    ~ControlSocket();
+
+    // Replaces a stale socket file left by a previous run, but not a live one
+    bool listen();
+    // Returns once stop becomes true
+    void serve(const Handler& handler, const std::atomic<bool>& stop);
+
+    // Client side: one request, the reply without its terminator
+    static bool request(const std::string& path, const std::string& line, std::string& reply);
+
+private:
+    void serveClient(int client, const Handler& handler, const std::atomic<bool>& stop);
+
+private:
+    std::string socketPath;
+    int listener{ -1 };
+};
@@ -0,0 +1,34 @@
+#include "CurlShare.h"
+
+#include <curl/curl.h>
+
+static void lockCallback(CURL*, curl_lock_data data, curl_lock_access, void* userdata) {
+    static_cast<std::mutex*>(userdata)[static_cast<unsigned>(data) % CurlShare::kLockCount].lock();
+}
+
+static void unlockCallback(CURL*, curl_lock_data data, void* userdata) {
+    static_cast<std::mutex*>(userdata)[static_cast<unsigned>(data) % CurlShare::kLockCount].unlock();
+}
+
+CurlShare::CurlShare()
+    : share(curl_share_init()) {
+    CURLSH* sh = static_cast<CURLSH*>(share);
+    if (!sh)
+        return;
+
+    curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, lockCallback);
+    curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, unlockCallback);
+    curl_share_setopt(sh, CURLSHOPT_USERDATA, static_cast<void*>(locks));
+    curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+CurlShare::~CurlShare() {
+    if (share)
+        curl_share_cleanup(static_cast<CURLSH*>(share));
+}
+
+void* CurlShare::handle() const {
+    return share;
+}
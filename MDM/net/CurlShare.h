@@ -0,0 +1,24 @@
+#pragma once
+#include <mutex>
+
+// DNS, TLS session and connection caches shared by every HttpClient that
+// is given this object, so transfers of different downloads reuse warm
+// connections. Must outlive those clients.
+class CurlShare {
+public:
+    CurlShare();
+    ~CurlShare();
+
+    CurlShare(const CurlShare&) = delete;
+    CurlShare& operator=(const CurlShare&) = delete;
+
+    // CURLSH*; nullptr if curl could not create one
+    void* handle() const;
+
+    // One per curl_lock_data value
+    static constexpr int kLockCount = 16;
+
+private:
+    void* share;
+    std::mutex locks[kLockCount];
+};
@@ -2,6 +2,13 @@
 
 #include <curl/curl.h>
 #include <sstream>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+
+#include "MultipartParser.h"
 
 static size_t writeCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
     auto* cb = static_cast<std::function<bool(const char*, std::size_t)>*>(userdata);
@@ -11,22 +18,81 @@ static size_t writeCallback(char* ptr, size_t size, size_t nmemb, void* userdata
     return total;
 }
 
+static int xferInfoCallback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    auto* flag = static_cast<const std::atomic<bool>*>(userdata);
+    return flag && flag->load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+static int sockoptCallback(void* userdata, curl_socket_t fd, curlsocktype) {
+    // Best effort: a rejected option must not fail the connection
+    SocketTuning::apply(static_cast<std::intptr_t>(fd), *static_cast<const SocketOptions*>(userdata));
+    return CURL_SOCKOPT_OK;
+}
+
+static bool headerIs(const std::string& header, const char* name, std::string& value) {
+    const std::size_t n = std::strlen(name);
+    if (header.size() < n)
+        return false;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (std::tolower(static_cast<unsigned char>(header[i])) != name[i])
+            return false;
+    }
+
+    const std::size_t first = header.find_first_not_of(" \t", n);
+    const std::size_t last = header.find_last_not_of(" \t\r\n");
+    value = (first == std::string::npos || last < first) ? std::string() : header.substr(first, last - first + 1);
+    return true;
+}
+
 static size_t headerCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
     std::size_t total = size * nitems;
     auto* result = static_cast<HttpHeadResult*>(userdata);
 
     std::string header(buffer, total);
+    std::string value;
 
-    if (header.rfind("Content-Length:", 0) == 0) {
-        result->contentLength = std::stoull(header.substr(15));
+    // A new status line means a redirect or 1xx; only the last response counts
+    if (header.rfind("HTTP/", 0) == 0) {
+        *result = HttpHeadResult{};
+        const std::size_t sp = header.find(' ');
+        if (sp != std::string::npos)
+            result->status = std::strtol(header.c_str() + sp + 1, nullptr, 10);
+    }
+    else if (headerIs(header, "content-length:", value)) {
+        result->contentLength = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    else if (headerIs(header, "etag:", value)) {
+        result->etag = value;
     }
-    else if (header.rfind("ETag:", 0) == 0) {
-        result->etag = header.substr(5);
+    else if (headerIs(header, "repr-digest:", value)) {
+        result->digest = value;
     }
-    else if (header.rfind("Accept-Ranges:", 0) == 0) {
-        if (header.find("bytes") != std::string::npos)
+    else if (headerIs(header, "digest:", value)) {
+        if (result->digest.empty())
+            result->digest = value;
+    }
+    else if (headerIs(header, "accept-ranges:", value)) {
+        if (value.find("bytes") != std::string::npos)
             result->acceptRanges = true;
     }
+    else if (headerIs(header, "content-type:", value)) {
+        result->contentType = value;
+    }
+    else if (headerIs(header, "content-range:", value)) {
+        // bytes <first>-<last>/<length or *>
+        const std::size_t sp = value.find(' ');
+        const std::size_t dash = value.find('-');
+        const std::size_t slash = value.find('/');
+        if (sp != std::string::npos && dash != std::string::npos && slash != std::string::npos
+            && sp < dash && dash < slash) {
+            result->rangeFirst = std::strtoull(value.c_str() + sp + 1, nullptr, 10);
+            result->rangeLast = std::strtoull(value.c_str() + dash + 1, nullptr, 10);
+            result->instanceLength = value[slash + 1] == '*'
+                ? 0
+                : std::strtoull(value.c_str() + slash + 1, nullptr, 10);
+            result->hasContentRange = true;
+        }
+    }
 
     return total;
 }
@@ -42,7 +108,7 @@ HttpClient::~HttpClient() {
         curl_easy_cleanup(static_cast<CURL*>(curl));
 }
 
-bool HttpClient::head(HttpHeadResult& out) {
+bool HttpClient::head(HttpHeadResult& out, const std::string& ifNoneMatch) {
     CURL* c = static_cast<CURL*>(curl);
     if (!c)
         return false;
@@ -50,40 +116,318 @@ bool HttpClient::head(HttpHeadResult& out) {
     //curl_easy_setopt(c, CURLOPT_URL, url.c_str());
     curl_easy_reset(c);
 
+    curl_slist* headers = nullptr;
+    if (!ifNoneMatch.empty())
+        headers = curl_slist_append(headers, ("If-None-Match: " + ifNoneMatch).c_str());
+
     curl_easy_setopt(c, CURLOPT_URL, url.c_str());
     curl_easy_setopt(c, CURLOPT_NOBODY, 1L);
     curl_easy_setopt(c, CURLOPT_HEADERFUNCTION, headerCallback);
     curl_easy_setopt(c, CURLOPT_HEADERDATA, &out);
     curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
+    if (headers)
+        curl_easy_setopt(c, CURLOPT_HTTPHEADER, headers);
+    applyConnectionOptions();
 
-    return curl_easy_perform(c) == CURLE_OK;
+    const bool ok = curl_easy_perform(c) == CURLE_OK;
+    curl_slist_free_all(headers);
+    return ok;
+}
+
+bool HttpClient::get(const std::function<bool(const char*, std::size_t)>& onData) {
+    CURL* c = static_cast<CURL*>(curl);
+    if (!c)
+        return false;
+
+    curl_easy_reset(c);
+
+    curl_easy_setopt(c, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(c, CURLOPT_WRITEDATA, (void*)&onData);
+    curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
+    installAbortHook();
+    applyConnectionOptions();
+
+    CURLcode res = curl_easy_perform(c);
+    recordStats(res);
+    if (res != CURLE_OK)
+        return false;
+
+    long status = 0;
+    curl_easy_getinfo(c, CURLINFO_RESPONSE_CODE, &status);
+
+    stats.failed = status != 200;
+    return status == 200;
 }
 
 bool HttpClient::getRange(std::uint64_t offset,
     std::uint64_t size,
     const std::function<bool(const char*, std::size_t)>& onData) {
+    return rangeRequest(offset, size, onData, nullptr, true) == 206;
+}
+
+bool HttpClient::probe(std::uint64_t size,
+    HttpHeadResult& headers,
+    const std::function<bool(const char*, std::size_t)>& onData) {
+    const long status = rangeRequest(0, size, onData, &headers, false);
+    return status == 206 || status == 200;
+}
+
+long HttpClient::rangeRequest(std::uint64_t offset,
+    std::uint64_t size,
+    const std::function<bool(const char*, std::size_t)>& onData,
+    HttpHeadResult* headers,
+    bool exact) {
     CURL* c = static_cast<CURL*>(curl);
     if (!c)
-        return false;
+        return 0;
 
     curl_easy_reset(c);
 
     std::ostringstream range;
     range << offset << "-" << (offset + size - 1);
+    const std::string rangeStr = range.str();
+
+    HttpHeadResult own;
+    HttpHeadResult& received = headers ? *headers : own;
+    bool checked = false;
+
+    // Headers are complete before the first body byte. Error pages and
+    // whole-file answers must never reach the caller as range data.
+    const std::function<bool(const char*, std::size_t)> deliver = [&](const char* data, std::size_t len) {
+        if (!checked) {
+            checked = true;
+            if (exact && !(received.status == 206 && received.hasContentRange && received.rangeFirst == offset))
+                return false;
+        }
+        return onData(data, len);
+    };
 
     curl_easy_setopt(c, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(c, CURLOPT_RANGE, range.str().c_str());
+    curl_easy_setopt(c, CURLOPT_RANGE, rangeStr.c_str());
     curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(c, CURLOPT_WRITEDATA, (void*)&onData);
+    curl_easy_setopt(c, CURLOPT_WRITEDATA, (void*)&deliver);
     curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(c, CURLOPT_HEADERFUNCTION, headerCallback);
+    curl_easy_setopt(c, CURLOPT_HEADERDATA, &received);
+    installAbortHook();
+    applyConnectionOptions();
 
     CURLcode res = curl_easy_perform(c);
+    recordStats(res);
+
     if (res != CURLE_OK)
-        return false;
+        return 0;
 
     long status = 0;
     curl_easy_getinfo(c, CURLINFO_RESPONSE_CODE, &status);
 
-    return status == 206;
+    if (exact && status == 206 && !(received.hasContentRange && received.rangeFirst == offset))
+        status = 0;
+    stats.failed = status != 206 && (exact || status != 200);
+    return status;
+}
+
+const HttpTransferStats& HttpClient::lastStats() const {
+    return stats;
 }
 
+namespace {
+struct MultiRangeState {
+    CURL* handle{ nullptr };
+    HttpHeadResult headers;
+    const std::function<bool(std::uint64_t, const char*, std::size_t)>* onData{ nullptr };
+    std::unique_ptr<MultipartParser> parser;
+    bool decided{ false };
+    bool unsupported{ false };
+    std::uint64_t singleOffset{ 0 };
+};
+}
+
+static size_t multiRangeWriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    auto* st = static_cast<MultiRangeState*>(userdata);
+    const std::size_t total = size * nmemb;
+
+    if (!st->decided) {
+        st->decided = true;
+
+        long status = 0;
+        curl_easy_getinfo(st->handle, CURLINFO_RESPONSE_CODE, &status);
+        if (status != 206) {
+            // Only a whole-file answer says the server ignores ranges; error
+            // responses just fail this request
+            st->unsupported = status == 200;
+            return 0;
+        }
+
+        const std::string boundary = MultipartParser::boundaryFrom(st->headers.contentType);
+        if (!boundary.empty())
+            st->parser = std::make_unique<MultipartParser>(boundary, *st->onData);
+        else if (st->headers.hasContentRange)
+            st->singleOffset = st->headers.rangeFirst;
+        else
+            return 0;
+    }
+
+    if (st->parser)
+        return st->parser->feed(ptr, total) ? total : 0;
+
+    // Single-part 206: plain body for the range named in Content-Range
+    if (!(*st->onData)(st->singleOffset, ptr, total))
+        return 0;
+    st->singleOffset += total;
+    return total;
+}
+
+MultiRangeResult HttpClient::getRanges(const std::vector<ByteRange>& ranges,
+    const std::function<bool(std::uint64_t, const char*, std::size_t)>& onData) {
+    CURL* c = static_cast<CURL*>(curl);
+    if (!c || ranges.empty())
+        return MultiRangeResult::Failed;
+
+    curl_easy_reset(c);
+
+    std::ostringstream range;
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+        if (i > 0)
+            range << ",";
+        range << ranges[i].offset << "-" << (ranges[i].offset + ranges[i].size - 1);
+    }
+    const std::string rangeStr = range.str();
+
+    MultiRangeState st;
+    st.handle = c;
+    st.onData = &onData;
+
+    curl_easy_setopt(c, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(c, CURLOPT_RANGE, rangeStr.c_str());
+    curl_easy_setopt(c, CURLOPT_HEADERFUNCTION, headerCallback);
+    curl_easy_setopt(c, CURLOPT_HEADERDATA, &st.headers);
+    curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, multiRangeWriteCallback);
+    curl_easy_setopt(c, CURLOPT_WRITEDATA, (void*)&st);
+    curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
+    installAbortHook();
+    applyConnectionOptions();
+
+    CURLcode res = curl_easy_perform(c);
+    recordStats(res);
+
+    long status = 0;
+    curl_easy_getinfo(c, CURLINFO_RESPONSE_CODE, &status);
+
+    if (st.unsupported)
+        return MultiRangeResult::Unsupported;
+    if (res != CURLE_OK || status != 206 || (st.parser && !st.parser->complete())) {
+        stats.failed = true;
+        return MultiRangeResult::Failed;
+    }
+
+    return st.parser ? MultiRangeResult::Ok : MultiRangeResult::SinglePart;
+}
+
+void HttpClient::recordStats(int result) {
+    CURL* c = static_cast<CURL*>(curl);
+    stats.failed = result != CURLE_OK && result != CURLE_ABORTED_BY_CALLBACK;
+    stats.connectFailed = result == CURLE_COULDNT_CONNECT
+        || result == CURLE_INTERFACE_FAILED
+        || result == CURLE_COULDNT_RESOLVE_HOST;
+
+    double pretransfer = 0.0, firstByte = 0.0;
+    curl_easy_getinfo(c, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+    curl_easy_getinfo(c, CURLINFO_STARTTRANSFER_TIME, &firstByte);
+    curl_easy_getinfo(c, CURLINFO_TOTAL_TIME, &stats.totalSeconds);
+    stats.firstByteSeconds = firstByte > pretransfer ? firstByte - pretransfer : 0.0;
+
+    curl_off_t received = 0;
+    curl_easy_getinfo(c, CURLINFO_SIZE_DOWNLOAD_T, &received);
+    stats.bytes = received > 0 ? static_cast<std::uint64_t>(received) : 0;
+
+    // The connection stays cached after the transfer, so it can be sampled
+    curl_socket_t sock = CURL_SOCKET_BAD;
+    stats.tcp = TcpSample{};
+    if (curl_easy_getinfo(c, CURLINFO_ACTIVESOCKET, &sock) == CURLE_OK && sock != CURL_SOCKET_BAD)
+        SocketTuning::sample(static_cast<std::intptr_t>(sock), stats.tcp);
+}
+
+void HttpClient::setAbortFlag(const std::atomic<bool>* flag) {
+    abortFlag = flag;
+}
+
+void HttpClient::installAbortHook() {
+    if (!abortFlag)
+        return;
+
+    CURL* c = static_cast<CURL*>(curl);
+    curl_easy_setopt(c, CURLOPT_XFERINFOFUNCTION, xferInfoCallback);
+    curl_easy_setopt(c, CURLOPT_XFERINFODATA, (void*)abortFlag);
+    curl_easy_setopt(c, CURLOPT_NOPROGRESS, 0L);
+}
+
+void HttpClient::setInterface(const std::string& name) {
+    bindInterface = name;
+    if (splice)
+        splice->setInterface(name);
+}
+
+const std::string& HttpClient::interfaceName() const {
+    return bindInterface;
+}
+
+void HttpClient::setSocketOptions(const SocketOptions* options) {
+    socketOptions = options;
+    if (splice)
+        splice->setSocketOptions(options);
+}
+
+void HttpClient::setShare(void* share) {
+    shareHandle = share;
+}
+
+void HttpClient::applyConnectionOptions() {
+    CURL* c = static_cast<CURL*>(curl);
+
+    if (shareHandle)
+        curl_easy_setopt(c, CURLOPT_SHARE, shareHandle);
+
+    // curl accepts an interface name, an address or a host name here
+    if (!bindInterface.empty())
+        curl_easy_setopt(c, CURLOPT_INTERFACE, bindInterface.c_str());
+
+    if (!socketOptions)
+        return;
+    curl_easy_setopt(c, CURLOPT_SOCKOPTFUNCTION, sockoptCallback);
+    curl_easy_setopt(c, CURLOPT_SOCKOPTDATA, (void*)socketOptions);
+    if (socketOptions->lowSpeedLimit > 0) {
+        curl_easy_setopt(c, CURLOPT_LOW_SPEED_LIMIT, socketOptions->lowSpeedLimit);
+        curl_easy_setopt(c, CURLOPT_LOW_SPEED_TIME, socketOptions->lowSpeedSeconds);
+    }
+}
+
+void HttpClient::setZeroCopy(bool enabled) {
+    zeroCopy = enabled;
+}
+
+SpliceResult HttpClient::spliceRange(std::uint64_t offset,
+    std::uint64_t size,
+    int fd,
+    const std::function<bool(std::size_t)>& onBytes) {
+    if (!zeroCopy || fd < 0)
+        return SpliceResult::Unsupported;
+
+    if (!splice) {
+        splice = std::make_unique<SpliceTransport>(url);
+        splice->setInterface(bindInterface);
+        splice->setSocketOptions(socketOptions);
+    }
+    if (!splice->valid()) {
+        zeroCopy = false;
+        return SpliceResult::Unsupported;
+    }
+
+    // Redirects, chunked or whole-body answers: leave this server to curl
+    const SpliceResult result = splice->fetch(offset, size, fd, abortFlag, onBytes, stats);
+    if (result == SpliceResult::Unsupported)
+        zeroCopy = false;
+    stats.failed = result == SpliceResult::Failed && !(abortFlag && abortFlag->load(std::memory_order_relaxed));
+    return result;
+}
@@ -1,12 +1,51 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
 #include <functional>
 #include <cstdint>
 
+#include "SpliceTransport.h"
+#include "SocketTuning.h"
+
 struct HttpHeadResult {
+    long status = 0;
     std::uint64_t contentLength = 0;
     std::string etag;
+    // Digest or Repr-Digest value, if the server sends one
+    std::string digest;
     bool acceptRanges = false;
+    std::string contentType;
+
+    // Content-Range of a 206 response: bytes rangeFirst-rangeLast/instanceLength
+    bool hasContentRange = false;
+    std::uint64_t rangeFirst = 0;
+    std::uint64_t rangeLast = 0;
+    std::uint64_t instanceLength = 0;
+};
+
+struct ByteRange {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+enum class MultiRangeResult {
+    Ok,          // multipart response parsed; some ranges may still be missing
+    SinglePart,  // server answered a single range; its data was delivered
+    Unsupported, // server answered 200 with the full body, nothing was written
+    Failed
+};
+
+struct HttpTransferStats {
+    double firstByteSeconds = 0.0; // request sent -> first byte received
+    double totalSeconds = 0.0;
+    std::uint64_t bytes = 0;
+    TcpSample tcp; // connection state after the transfer
+    // The request did not succeed (aborts by the caller's flag excluded);
+    // connectFailed when no connection could be made at all
+    bool failed = false;
+    bool connectFailed = false;
 };
 
 class HttpClient {
@@ -14,12 +53,74 @@ public:
     explicit HttpClient(const std::string& url);
     ~HttpClient();
 
-    bool head(HttpHeadResult& out);
+    // With ifNoneMatch set this is a revalidation: 304 means unchanged
+    bool head(HttpHeadResult& out, const std::string& ifNoneMatch = std::string());
+    // Whole-body GET, for small side files such as checksum indexes
+    bool get(const std::function<bool(const char*, std::size_t)>& onData);
+    // Body bytes are delivered only for a 206 whose Content-Range starts at
+    // `offset`; any other answer fails without calling onData
     bool getRange(std::uint64_t offset,
         std::uint64_t size,
         const std::function<bool(const char*, std::size_t)>& onData);
 
+    // First request of a download: a ranged GET for the first `size` bytes
+    // whose response headers are in `headers` before onData first runs, so
+    // the caller can plan from Content-Range while the body streams. A
+    // server that ignores Range answers 200 with the whole body, which is
+    // accepted as well (check headers.status).
+    bool probe(std::uint64_t size,
+        HttpHeadResult& headers,
+        const std::function<bool(const char*, std::size_t)>& onData);
+
+    // Fetch several ranges in one request. Data is delivered with its
+    // absolute offset; a server may coalesce or drop ranges, so the caller
+    // must track which bytes actually arrived.
+    MultiRangeResult getRanges(const std::vector<ByteRange>& ranges,
+        const std::function<bool(std::uint64_t, const char*, std::size_t)>& onData);
+
+    const HttpTransferStats& lastStats() const;
+
+    // Local interface name or source address for every request; empty
+    // uses the default route
+    void setInterface(const std::string& name);
+    const std::string& interfaceName() const;
+    // Must outlive the client; nullptr keeps the defaults
+    void setSocketOptions(const SocketOptions* options);
+    // CURLSH* whose caches this client joins (see CurlShare)
+    void setShare(void* share);
+
+    // Plain http:// ranges may then be spliced from the socket straight
+    // into a file descriptor (see SpliceTransport)
+    void setZeroCopy(bool enabled);
+    // Unsupported means nothing was written and getRange() should be used;
+    // after one such response this client stops trying
+    SpliceResult spliceRange(std::uint64_t offset,
+        std::uint64_t size,
+        int fd,
+        const std::function<bool(std::size_t)>& onBytes);
+
+    // Transfers in progress are aborted (from curl's progress hook) as soon
+    // as the flag becomes true. Pass nullptr to detach.
+    void setAbortFlag(const std::atomic<bool>* flag);
+
+private:
+    long rangeRequest(std::uint64_t offset,
+        std::uint64_t size,
+        const std::function<bool(const char*, std::size_t)>& onData,
+        HttpHeadResult* headers,
+        bool exact);
+    void recordStats(int result);
+    void installAbortHook();
+    void applyConnectionOptions();
+
 private:
     void* curl;
     std::string url;
+    std::string bindInterface;
+    const SocketOptions* socketOptions{ nullptr };
+    void* shareHandle{ nullptr };
+    bool zeroCopy{ false };
+    std::unique_ptr<SpliceTransport> splice;
+    HttpTransferStats stats;
+    const std::atomic<bool>* abortFlag{ nullptr };
 };
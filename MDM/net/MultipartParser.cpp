@@ -0,0 +1,132 @@
+#include "MultipartParser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// Guard against a peer that never sends a line terminator
+constexpr std::size_t kMaxLine = 8 * 1024;
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+}
+
+MultipartParser::MultipartParser(const std::string& boundary, PartDataFn onData)
+    : delimiter("--" + boundary), onPart(std::move(onData)) {
+}
+
+bool MultipartParser::feed(const char* data, std::size_t size) {
+    while (size > 0) {
+        if (state == State::Done)
+            return true; // epilogue is ignored
+
+        if (state == State::Body) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(partRemaining, size));
+            if (!onPart(partOffset, data, n))
+                return false;
+
+            partOffset += n;
+            partRemaining -= n;
+            data += n;
+            size -= n;
+
+            if (partRemaining == 0)
+                state = State::Delimiter;
+            continue;
+        }
+
+        const char* nl = static_cast<const char*>(std::memchr(data, '\n', size));
+        const std::size_t n = nl ? static_cast<std::size_t>(nl - data) + 1 : size;
+        line.append(data, n);
+        data += n;
+        size -= n;
+
+        if (!nl) {
+            if (line.size() > kMaxLine)
+                return false;
+            continue;
+        }
+
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+            line.pop_back();
+
+        const std::string current = std::move(line);
+        line.clear();
+        if (!onLine(current))
+            return false;
+    }
+    return true;
+}
+
+bool MultipartParser::onLine(const std::string& text) {
+    if (state == State::Delimiter) {
+        if (text == delimiter + "--") {
+            state = State::Done;
+        }
+        else if (text == delimiter) {
+            state = State::Headers;
+            partHasRange = false;
+        }
+        // Anything else is preamble or the CRLF that ends a part body
+        return true;
+    }
+
+    // State::Headers
+    if (text.empty()) {
+        if (!partHasRange)
+            return false;
+        state = partRemaining > 0 ? State::Body : State::Delimiter;
+        return true;
+    }
+
+    const std::string lowered = lower(text);
+    if (lowered.rfind("content-range:", 0) == 0) {
+        // Content-Range: bytes <first>-<last>/<total>
+        const std::size_t pos = lowered.find("bytes");
+        if (pos == std::string::npos)
+            return false;
+
+        char* end = nullptr;
+        const char* p = text.c_str() + pos + 5;
+        const std::uint64_t first = std::strtoull(p, &end, 10);
+        if (!end || *end != '-')
+            return false;
+        const std::uint64_t last = std::strtoull(end + 1, &end, 10);
+        if (last < first)
+            return false;
+
+        partOffset = first;
+        partRemaining = last - first + 1;
+        partHasRange = true;
+    }
+    return true;
+}
+
+bool MultipartParser::complete() const {
+    return state == State::Done;
+}
+
+std::string MultipartParser::boundaryFrom(const std::string& contentType) {
+    const std::string lowered = lower(contentType);
+    if (lowered.find("multipart/byteranges") == std::string::npos)
+        return {};
+
+    const std::size_t pos = lowered.find("boundary=");
+    if (pos == std::string::npos)
+        return {};
+
+    std::string boundary = contentType.substr(pos + 9);
+    const std::size_t end = boundary.find_first_of(";\r\n");
+    if (end != std::string::npos)
+        boundary.resize(end);
+    while (!boundary.empty() && boundary.back() == ' ')
+        boundary.pop_back();
+    if (boundary.size() >= 2 && boundary.front() == '"' && boundary.back() == '"')
+        boundary = boundary.substr(1, boundary.size() - 2);
+    return boundary;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Incremental parser for a multipart/byteranges response body. Each part's
+// payload is delivered with its absolute offset taken from the part's
+// Content-Range header.
+class MultipartParser {
+public:
+    using PartDataFn = std::function<bool(std::uint64_t offset, const char* data, std::size_t size)>;
+
+    MultipartParser(const std::string& boundary, PartDataFn onData);
+
+    bool feed(const char* data, std::size_t size);
+    // True once the closing delimiter has been seen.
+    bool complete() const;
+
+    // Extracts the boundary parameter of a multipart/byteranges Content-Type,
+    // empty if the type is something else.
+    static std::string boundaryFrom(const std::string& contentType);
+
+private:
+    bool onLine(const std::string& line);
+
+private:
+    enum class State { Delimiter, Headers, Body, Done };
+
+    std::string delimiter;
+    PartDataFn onPart;
+
+    State state{ State::Delimiter };
+    std::string line;
+    std::uint64_t partOffset{ 0 };
+    std::uint64_t partRemaining{ 0 };
+    bool partHasRange{ false };
+};
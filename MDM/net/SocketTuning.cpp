@@ -0,0 +1,74 @@
+#include "SocketTuning.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+bool SocketTuning::apply(std::intptr_t socket, const SocketOptions& options) {
+    bool ok = true;
+
+#ifdef _WIN32
+    const SOCKET s = static_cast<SOCKET>(socket);
+    if (options.receiveBuffer > 0)
+        ok = setsockopt(s, SOL_SOCKET, SO_RCVBUF,
+            reinterpret_cast<const char*>(&options.receiveBuffer), sizeof(int)) == 0 && ok;
+    if (options.keepAliveSeconds > 0) {
+        const BOOL on = TRUE;
+        ok = setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<const char*>(&on), sizeof(on)) == 0 && ok;
+    }
+    if (!options.congestion.empty())
+        ok = false;
+#else
+    const int fd = static_cast<int>(socket);
+    if (options.receiveBuffer > 0)
+        ok = setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &options.receiveBuffer, sizeof(int)) == 0 && ok;
+
+    if (options.keepAliveSeconds > 0) {
+        const int on = 1;
+        ok = setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) == 0 && ok;
+#ifdef TCP_KEEPIDLE
+        ok = setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &options.keepAliveSeconds, sizeof(int)) == 0 && ok;
+        ok = setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &options.keepAliveSeconds, sizeof(int)) == 0 && ok;
+#endif
+    }
+
+    if (!options.congestion.empty()) {
+#ifdef TCP_CONGESTION
+        ok = setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, options.congestion.c_str(),
+            static_cast<socklen_t>(options.congestion.size())) == 0 && ok;
+#else
+        ok = false;
+#endif
+    }
+#endif
+
+    return ok;
+}
+
+bool SocketTuning::sample(std::intptr_t socket, TcpSample& out) {
+    out = TcpSample{};
+#ifdef __linux__
+    tcp_info info{};
+    socklen_t len = sizeof(info);
+    if (getsockopt(static_cast<int>(socket), IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+        return false;
+
+    out.valid = true;
+    out.rttMs = info.tcpi_rtt / 1000.0;
+    out.rttVarMs = info.tcpi_rttvar / 1000.0;
+    out.rcvRttMs = info.tcpi_rcv_rtt / 1000.0;
+    out.rcvSpace = info.tcpi_rcv_space;
+    out.cwnd = info.tcpi_snd_cwnd;
+    out.mss = info.tcpi_snd_mss;
+    out.retransmits = info.tcpi_total_retrans;
+    out.lost = info.tcpi_lost;
+    return true;
+#else
+    (void)socket;
+    return false;
+#endif
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+
+#include "../core/utils.h"
+
+// TCP_INFO of one connection, as seen from our (receiving) side
+struct TcpSample {
+    bool valid = false;
+    double rttMs = 0.0;
+    double rttVarMs = 0.0;
+    double rcvRttMs = 0.0;       // receiver-side RTT estimate
+    std::uint32_t rcvSpace = 0;  // receive window the kernel grew to
+    std::uint32_t cwnd = 0;      // segments
+    std::uint32_t mss = 0;
+    std::uint32_t retransmits = 0;
+    std::uint32_t lost = 0;
+};
+
+// Socket options and diagnostics shared by the curl and splice transports.
+// Unsupported options are skipped; they are tuning, not requirements.
+class SocketTuning {
+public:
+    // Before connect(), so the receive buffer shapes window scaling.
+    // False if an option was rejected (e.g. congestion module not loaded).
+    static bool apply(std::intptr_t socket, const SocketOptions& options);
+    static bool sample(std::intptr_t socket, TcpSample& out);
+};
@@ -0,0 +1,397 @@
+#include "SpliceTransport.h"
+#include "HttpClient.h"
+#include "SocketTuning.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace {
+// Bytes moved per splice() pair, and the pipe is sized to hold them
+constexpr std::size_t kSpliceChunk = 1024 * 1024;
+constexpr std::size_t kMaxHeaderSize = 64 * 1024;
+// Abort flag polling interval, and how long a silent socket is tolerated
+constexpr int kPollMs = 200;
+constexpr int kStallMs = 60 * 1000;
+
+bool headerValue(const std::string& headers, const char* name, std::string& value) {
+    const std::size_t n = std::strlen(name);
+    std::size_t pos = headers.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < headers.size()) {
+        const std::size_t begin = pos + 2;
+        const std::size_t end = headers.find("\r\n", begin);
+        const std::size_t lineEnd = end == std::string::npos ? headers.size() : end;
+        if (lineEnd - begin > n && headers[begin + n] == ':') {
+            bool match = true;
+            for (std::size_t i = 0; i < n && match; ++i)
+                match = std::tolower(static_cast<unsigned char>(headers[begin + i])) == name[i];
+            if (match) {
+                const std::size_t first = headers.find_first_not_of(" \t", begin + n + 1);
+                value = first >= lineEnd ? std::string() : headers.substr(first, lineEnd - first);
+                while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+                    value.pop_back();
+                return true;
+            }
+        }
+        pos = end;
+    }
+    return false;
+}
+}
+
+SpliceTransport::SpliceTransport(const std::string& url) {
+    // http://host[:port][/path]; IPv6 literals are left to curl
+    const std::string scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0)
+        return;
+
+    const std::size_t authStart = scheme.size();
+    const std::size_t pathStart = url.find_first_of("/?#", authStart);
+    const std::string authority = url.substr(authStart, pathStart == std::string::npos ? std::string::npos : pathStart - authStart);
+    if (authority.empty() || authority.find_first_of("@[]") != std::string::npos)
+        return;
+
+    const std::size_t colon = authority.find(':');
+    host = authority.substr(0, colon);
+    if (colon != std::string::npos)
+        port = authority.substr(colon + 1);
+    if (host.empty() || port.empty())
+        return;
+
+    target = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+    const std::size_t hash = target.find('#');
+    if (hash != std::string::npos)
+        target.resize(hash);
+    if (target.empty() || target[0] != '/')
+        target.insert(0, "/");
+
+#ifdef __linux__
+    ok = true;
+#endif
+}
+
+SpliceTransport::~SpliceTransport() {
+    closeSocket();
+    closePipe();
+}
+
+bool SpliceTransport::valid() const {
+    return ok;
+}
+
+void SpliceTransport::setInterface(const std::string& name) {
+    if (name != bindInterface)
+        closeSocket();
+    bindInterface = name;
+}
+
+void SpliceTransport::setSocketOptions(const SocketOptions* options) {
+    socketOptions = options;
+}
+
+#ifdef __linux__
+
+bool SpliceTransport::connectSocket() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+        return false;
+
+    for (addrinfo* ai = res; ai && sock < 0; ai = ai->ai_next) {
+        sock = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (sock < 0)
+            continue;
+        if (socketOptions)
+            SocketTuning::apply(sock, *socketOptions);
+
+        bool bound = true;
+        if (!bindInterface.empty()) {
+            // An address binds the source, anything else names a device
+            sockaddr_storage local{};
+            socklen_t localLen = 0;
+            if (ai->ai_family == AF_INET
+                && inet_pton(AF_INET, bindInterface.c_str(), &reinterpret_cast<sockaddr_in&>(local).sin_addr) == 1) {
+                local.ss_family = AF_INET;
+                localLen = sizeof(sockaddr_in);
+            }
+            else if (ai->ai_family == AF_INET6
+                && inet_pton(AF_INET6, bindInterface.c_str(), &reinterpret_cast<sockaddr_in6&>(local).sin6_addr) == 1) {
+                local.ss_family = AF_INET6;
+                localLen = sizeof(sockaddr_in6);
+            }
+
+            if (localLen > 0)
+                bound = ::bind(sock, reinterpret_cast<sockaddr*>(&local), localLen) == 0;
+            else if (if_nametoindex(bindInterface.c_str()) != 0)
+                bound = setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE,
+                    bindInterface.c_str(), static_cast<socklen_t>(bindInterface.size())) == 0;
+            else
+                bound = false;
+        }
+
+        if (!bound || ::connect(sock, ai->ai_addr, ai->ai_addrlen) != 0) {
+            ::close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (sock < 0)
+        return false;
+
+    const int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (pipeFds[0] < 0) {
+        if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+            pipeFds[0] = pipeFds[1] = -1;
+            closeSocket();
+            return false;
+        }
+        // Best effort; the default 64 KiB pipe just means more splice calls
+        fcntl(pipeFds[1], F_SETPIPE_SZ, static_cast<int>(kSpliceChunk));
+    }
+    return true;
+}
+
+void SpliceTransport::closeSocket() {
+    if (sock >= 0) {
+        ::close(sock);
+        sock = -1;
+    }
+}
+
+void SpliceTransport::closePipe() {
+    if (pipeFds[0] >= 0) {
+        ::close(pipeFds[0]);
+        ::close(pipeFds[1]);
+        pipeFds[0] = pipeFds[1] = -1;
+    }
+}
+
+bool SpliceTransport::sendAll(const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = ::send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool SpliceTransport::waitReadable(const std::atomic<bool>* abortFlag) {
+    const int stallMs = socketOptions && socketOptions->lowSpeedLimit > 0
+        ? static_cast<int>(socketOptions->lowSpeedSeconds * 1000)
+        : kStallMs;
+    for (int waited = 0; waited < stallMs; waited += kPollMs) {
+        if (abortFlag && abortFlag->load(std::memory_order_relaxed))
+            return false;
+        pollfd p{ sock, POLLIN, 0 };
+        const int r = ::poll(&p, 1, kPollMs);
+        if (r > 0)
+            return true;
+        if (r < 0 && errno != EINTR)
+            return false;
+    }
+    return false;
+}
+
+SpliceResult SpliceTransport::fetch(std::uint64_t offset,
+    std::uint64_t size,
+    int fd,
+    const std::atomic<bool>* abortFlag,
+    const std::function<bool(std::size_t)>& onBytes,
+    HttpTransferStats& stats) {
+    stats = HttpTransferStats{};
+    if (!ok || size == 0)
+        return SpliceResult::Unsupported;
+
+    const auto started = std::chrono::steady_clock::now();
+    const std::string request = "GET " + target + " HTTP/1.1\r\n"
+        "Host: " + host + (port == "80" ? std::string() : ":" + port) + "\r\n"
+        "Range: bytes=" + std::to_string(offset) + "-" + std::to_string(offset + size - 1) + "\r\n"
+        "User-Agent: mdm\r\n"
+        "Connection: keep-alive\r\n\r\n";
+
+    // A kept-alive connection may have been closed by the server in the
+    // meantime; that shows up as an immediate EOF and earns one retry
+    std::string buf;
+    std::size_t headerEnd = std::string::npos;
+    for (int attempt = 0; attempt < 2 && headerEnd == std::string::npos; ++attempt) {
+        const bool reused = sock >= 0;
+        if (!reused && !connectSocket()) {
+            stats.connectFailed = true;
+            return SpliceResult::Failed;
+        }
+
+        buf.clear();
+        bool eof = false;
+        if (sendAll(request)) {
+            char chunk[16 * 1024];
+            while (headerEnd == std::string::npos && buf.size() < kMaxHeaderSize) {
+                if (!waitReadable(abortFlag))
+                    break;
+                const ssize_t n = ::recv(sock, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    eof = true;
+                    break;
+                }
+                buf.append(chunk, static_cast<std::size_t>(n));
+                headerEnd = buf.find("\r\n\r\n");
+            }
+        }
+        else {
+            eof = true;
+        }
+
+        if (headerEnd == std::string::npos) {
+            closeSocket();
+            if (!(reused && eof && buf.empty()))
+                return SpliceResult::Failed;
+        }
+    }
+    if (headerEnd == std::string::npos)
+        return SpliceResult::Failed;
+
+    const std::string headers = buf.substr(0, headerEnd + 2);
+    stats.firstByteSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    // HTTP/1.1 206 ...
+    const std::size_t sp = headers.find(' ');
+    const long status = sp == std::string::npos ? 0 : std::strtol(headers.c_str() + sp + 1, nullptr, 10);
+
+    std::string value;
+    std::uint64_t length = 0;
+    bool usable = status == 206
+        && !headerValue(headers, "transfer-encoding", value)
+        && headerValue(headers, "content-length", value);
+    if (usable)
+        length = std::strtoull(value.c_str(), nullptr, 10);
+    if (usable && headerValue(headers, "content-range", value)) {
+        const std::size_t rsp = value.find(' ');
+        usable = rsp != std::string::npos
+            && std::strtoull(value.c_str() + rsp + 1, nullptr, 10) == offset;
+    }
+    else {
+        usable = false;
+    }
+    if (!usable || length != size) {
+        closeSocket();
+        return SpliceResult::Unsupported;
+    }
+
+    bool keepAlive = true;
+    if (headerValue(headers, "connection", value)) {
+        std::transform(value.begin(), value.end(), value.begin(),
+            [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+        keepAlive = value.find("close") == std::string::npos;
+    }
+
+    // Mid-body the pipe may still hold bytes of this response, so it goes
+    // together with the connection
+    std::uint64_t done = 0;
+    auto broken = [&]() {
+        SocketTuning::sample(sock, stats.tcp);
+        closeSocket();
+        closePipe();
+        stats.bytes = done;
+        return SpliceResult::Failed;
+    };
+
+    // Body bytes that came in with the headers are written normally
+    const std::size_t early = std::min<std::size_t>(buf.size() - headerEnd - 4, size);
+    if (early > 0) {
+        const char* p = buf.data() + headerEnd + 4;
+        std::size_t left = early;
+        while (left > 0) {
+            const ssize_t n = ::pwrite(fd, p, left, static_cast<off_t>(offset + (early - left)));
+            if (n <= 0)
+                return broken();
+            p += n;
+            left -= static_cast<std::size_t>(n);
+        }
+        done = early;
+        if (!onBytes(early))
+            return broken();
+    }
+
+    while (done < size) {
+        if (!waitReadable(abortFlag))
+            return broken();
+
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(size - done, kSpliceChunk));
+        const ssize_t in = ::splice(sock, nullptr, pipeFds[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (in <= 0)
+            return broken();
+
+        std::size_t inPipe = static_cast<std::size_t>(in);
+        while (inPipe > 0) {
+            loff_t at = static_cast<loff_t>(offset + done);
+            const ssize_t out = ::splice(pipeFds[0], nullptr, fd, &at, inPipe, SPLICE_F_MOVE);
+            if (out <= 0)
+                return broken();
+            inPipe -= static_cast<std::size_t>(out);
+            done += static_cast<std::uint64_t>(out);
+            if (!onBytes(static_cast<std::size_t>(out)))
+                return broken();
+        }
+    }
+
+    SocketTuning::sample(sock, stats.tcp);
+    if (!keepAlive)
+        closeSocket();
+
+    stats.bytes = done;
+    stats.totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return SpliceResult::Ok;
+}
+
+#else
+
+bool SpliceTransport::connectSocket() {
+    return false;
+}
+
+void SpliceTransport::closeSocket() {
+}
+
+void SpliceTransport::closePipe() {
+}
+
+bool SpliceTransport::sendAll(const std::string&) {
+    return false;
+}
+
+bool SpliceTransport::waitReadable(const std::atomic<bool>*) {
+    return false;
+}
+
+SpliceResult SpliceTransport::fetch(std::uint64_t,
+    std::uint64_t,
+    int,
+    const std::atomic<bool>*,
+    const std::function<bool(std::size_t)>&,
+    HttpTransferStats& stats) {
+    stats = HttpTransferStats{};
+    return SpliceResult::Unsupported;
+}
+
+#endif
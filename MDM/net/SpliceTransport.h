@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#include "../core/utils.h"
+
+struct HttpTransferStats;
+
+enum class SpliceResult {
+    Ok,
+    Failed,      // transfer broke off; onBytes saw what reached the file
+    Unsupported  // response not usable here, nothing was written
+};
+
+// Minimal HTTP/1.1 range client for plain http:// that moves the response
+// body from the socket into a file with splice() through a pipe, so body
+// bytes never pass through user space. Only a 206 with Content-Length
+// and a matching Content-Range is accepted; anything else (redirects,
+// chunked bodies, full 200 responses) is Unsupported and left to curl.
+// Linux only; elsewhere every request is Unsupported.
+class SpliceTransport {
+public:
+    explicit SpliceTransport(const std::string& url);
+    ~SpliceTransport();
+
+    // False for URLs this transport cannot serve (https, userinfo, ...)
+    bool valid() const;
+
+    // Local interface name or source address
+    void setInterface(const std::string& name);
+    // Must outlive the transport. A low-speed limit becomes a stall
+    // timeout of lowSpeedSeconds here.
+    void setSocketOptions(const SocketOptions* options);
+
+    // Writes [offset, offset + size) of the resource to fd at the same
+    // offsets. onBytes runs after each chunk lands in the file.
+    SpliceResult fetch(std::uint64_t offset,
+        std::uint64_t size,
+        int fd,
+        const std::atomic<bool>* abortFlag,
+        const std::function<bool(std::size_t)>& onBytes,
+        HttpTransferStats& stats);
+
+private:
+    bool connectSocket();
+    void closeSocket();
+    void closePipe();
+    bool sendAll(const std::string& data);
+    bool waitReadable(const std::atomic<bool>* abortFlag);
+
+private:
+    std::string host;
+    std::string port{ "80" };
+    std::string target;
+    std::string bindInterface;
+    const SocketOptions* socketOptions{ nullptr };
+    bool ok{ false };
+    int sock{ -1 };
+    int pipeFds[2]{ -1, -1 };
+};
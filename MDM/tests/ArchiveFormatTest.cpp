@@ -0,0 +1,221 @@
+#include "../io/ArchiveFormat.h"
+#include "Check.h"
+
+#include <string>
+
+// Build from MDM/: g++ -std=c++20 -I. tests/ArchiveFormatTest.cpp io/ArchiveFormat.cpp
+
+namespace {
+void put16(std::string& s, std::uint16_t v) {
+    s.push_back(static_cast<char>(v & 0xFF));
+    s.push_back(static_cast<char>(v >> 8));
+}
+
+void put32(std::string& s, std::uint32_t v) {
+    put16(s, static_cast<std::uint16_t>(v & 0xFFFF));
+    put16(s, static_cast<std::uint16_t>(v >> 16));
+}
+
+void put64(std::string& s, std::uint64_t v) {
+    put32(s, static_cast<std::uint32_t>(v & 0xFFFFFFFFu));
+    put32(s, static_cast<std::uint32_t>(v >> 32));
+}
+
+std::string endRecord(std::uint16_t entries, std::uint32_t cdSize, std::uint32_t cdOffset,
+    const std::string& comment = {}) {
+    std::string s;
+    put32(s, 0x06054b50);
+    put16(s, 0);
+    put16(s, 0);
+    put16(s, entries);
+    put16(s, entries);
+    put32(s, cdSize);
+    put32(s, cdOffset);
+    put16(s, static_cast<std::uint16_t>(comment.size()));
+    return s + comment;
+}
+
+std::string zip64Locator(std::uint64_t recordOffset) {
+    std::string s;
+    put32(s, 0x07064b50);
+    put32(s, 0);
+    put64(s, recordOffset);
+    put32(s, 1);
+    return s;
+}
+
+std::string zip64End(std::uint64_t cdSize, std::uint64_t cdOffset) {
+    std::string s;
+    put32(s, 0x06064b50);
+    put64(s, 44);
+    put16(s, 45);
+    put16(s, 45);
+    put32(s, 0);
+    put32(s, 0);
+    put64(s, 70000);
+    put64(s, 70000);
+    put64(s, cdSize);
+    put64(s, cdOffset);
+    return s;
+}
+
+std::string centralEntry(const std::string& name, std::uint32_t compressed, std::uint32_t size,
+    std::uint32_t offset, const std::string& extra = {}) {
+    std::string s;
+    put32(s, 0x02014b50);
+    put16(s, 45);
+    put16(s, 45);
+    put16(s, 0);            // flags
+    put16(s, 8);            // deflate
+    put32(s, 0);            // time, date
+    put32(s, 0x12345678);   // crc
+    put32(s, compressed);
+    put32(s, size);
+    put16(s, static_cast<std::uint16_t>(name.size()));
+    put16(s, static_cast<std::uint16_t>(extra.size()));
+    put16(s, 0);            // comment
+    put16(s, 0);
+    put16(s, 0);
+    put32(s, 0);
+    put32(s, offset);
+    return s + name + extra;
+}
+
+bool findEnd(const std::string& tail, ZipDirectory::End& end) {
+    return ZipDirectory::findEnd(tail.data(), tail.size(), end);
+}
+}
+
+static void findsPlainEnd() {
+    ZipDirectory::End end;
+    CHECK(findEnd("local data" + endRecord(3, 150, 4000), end));
+    CHECK(!end.zip64);
+    CHECK_EQ(end.cdSize, 150u);
+    CHECK_EQ(end.cdOffset, 4000u);
+
+    // A comment that itself contains an end signature does not fool it
+    const std::string fake = endRecord(1, 1, 1);
+    CHECK(findEnd("xx" + endRecord(2, 90, 1234, "note " + fake + " end"), end));
+    CHECK_EQ(end.cdSize, 90u);
+    CHECK_EQ(end.cdOffset, 1234u);
+}
+
+static void rejectsBrokenEnd() {
+    ZipDirectory::End end;
+    CHECK(!findEnd("", end));
+    CHECK(!findEnd(std::string(21, '\0'), end));
+    CHECK(!findEnd(std::string(200, 'a'), end));
+
+    // Comment length pointing past the data (truncated tail)
+    std::string cut = endRecord(1, 10, 20, "a comment");
+    cut.resize(cut.size() - 3);
+    CHECK(!findEnd(cut, end));
+
+    // Saturated fields need a ZIP64 locator
+    CHECK(!findEnd(endRecord(0xFFFF, 10, 20), end));
+    CHECK(!findEnd(endRecord(1, 0xFFFFFFFFu, 20), end));
+    CHECK(!findEnd(endRecord(1, 10, 0xFFFFFFFFu), end));
+}
+
+static void findsZip64End() {
+    ZipDirectory::End end;
+    const std::uint64_t recordOffset = 0x123456789ull;
+    CHECK(findEnd("data" + zip64Locator(recordOffset) + endRecord(0xFFFF, 0xFFFFFFFFu, 0xFFFFFFFFu), end));
+    CHECK(end.zip64);
+    CHECK_EQ(end.zip64RecordOffset, recordOffset);
+
+    const std::string record = zip64End(0x200000000ull, 0x300000000ull);
+    CHECK_EQ(record.size(), ZipDirectory::kZip64EndSize);
+    CHECK(ZipDirectory::parseZip64End(record.data(), record.size(), end));
+    CHECK_EQ(end.cdSize, 0x200000000ull);
+    CHECK_EQ(end.cdOffset, 0x300000000ull);
+}
+
+static void rejectsBrokenZip64End() {
+    ZipDirectory::End end;
+    const std::string record = zip64End(1, 2);
+    CHECK(!ZipDirectory::parseZip64End(record.data(), record.size() - 1, end));
+
+    std::string badSig = record;
+    badSig[0] = 'X';
+    CHECK(!ZipDirectory::parseZip64End(badSig.data(), badSig.size(), end));
+}
+
+static void measuresLocalHeader() {
+    std::string h;
+    put32(h, 0x04034b50);
+    h.append(22, '\0');
+    put16(h, 7);  // name
+    put16(h, 12); // extra
+    std::uint64_t length = 0;
+    CHECK(ZipDirectory::localHeaderLength(h.data(), h.size(), length));
+    CHECK_EQ(length, 30u + 7u + 12u);
+    CHECK(!ZipDirectory::localHeaderLength(h.data(), h.size() - 1, length));
+    h[0] = 'X';
+    CHECK(!ZipDirectory::localHeaderLength(h.data(), h.size(), length));
+}
+
+static void parsesCentralDirectory() {
+    // ZIP64 extra field: only the saturated values, size then compressed then offset
+    std::string extra;
+    put16(extra, 0x0001);
+    put16(extra, 16);
+    put64(extra, 0x100000000ull);
+    put64(extra, 0x500000000ull);
+
+    const std::string cd = centralEntry("a.txt", 10, 20, 0)
+        + centralEntry("big.bin", 1000, 0xFFFFFFFFu, 0xFFFFFFFFu, extra);
+
+    ZipDirectory dir;
+    CHECK(dir.parse(cd.data(), cd.size()));
+    CHECK_EQ(dir.entries().size(), 2u);
+    if (dir.entries().size() == 2) {
+        const ZipEntry& a = dir.entries()[0];
+        CHECK_EQ(a.name, "a.txt");
+        CHECK_EQ(a.method, 8u);
+        CHECK_EQ(a.crc, 0x12345678u);
+        CHECK_EQ(a.compressedSize, 10u);
+        CHECK_EQ(a.size, 20u);
+
+        const ZipEntry& big = dir.entries()[1];
+        CHECK_EQ(big.compressedSize, 1000u);
+        CHECK_EQ(big.size, 0x100000000ull);
+        CHECK_EQ(big.localHeaderOffset, 0x500000000ull);
+    }
+
+    // Truncated entry, or trailing bytes that are not an entry
+    CHECK(!dir.parse(cd.data(), cd.size() - 1));
+    const std::string trailing = cd + "junk";
+    CHECK(!dir.parse(trailing.data(), trailing.size()));
+}
+
+static void parsesTarFields() {
+    CHECK_EQ(TarFormat::parseNumber("0000644 ", 8), 0644u);
+    CHECK_EQ(TarFormat::parseNumber("  17\0\0\0", 7), 017u);
+    CHECK_EQ(TarFormat::parseNumber("", 0), 0u);
+    // Base-256 for sizes that do not fit in 11 octal digits
+    const char big[12] = { '\x80', 0, 0, 0, 0, 0, 0, 0x02, 0, 0, 0, 0 };
+    CHECK_EQ(TarFormat::parseNumber(big, 12), 0x200000000ull);
+
+    CHECK_EQ(TarFormat::padding(0), 0u);
+    CHECK_EQ(TarFormat::padding(1), 511u);
+    CHECK_EQ(TarFormat::padding(512), 0u);
+
+    CHECK_EQ(TarFormat::paxPath("20 path=renamed.txt\n"), "renamed.txt");
+    CHECK_EQ(TarFormat::paxPath("12 uid=1000\n14 path=a/b.c\n"), "a/b.c");
+    CHECK(TarFormat::paxPath("12 uid=1000\n").empty());
+    // Lengths that run past the data stop the scan
+    CHECK(TarFormat::paxPath("99 path=x\n").empty());
+    CHECK(TarFormat::paxPath("zz path=x\n").empty());
+}
+
+int main() {
+    findsPlainEnd();
+    rejectsBrokenEnd();
+    findsZip64End();
+    rejectsBrokenZip64End();
+    measuresLocalHeader();
+    parsesCentralDirectory();
+    parsesTarFields();
+    return test::result();
+}
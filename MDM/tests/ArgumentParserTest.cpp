@@ -0,0 +1,77 @@
+#include "../cli/ArgumentParser.h"
+#include "Check.h"
+
+#include <string>
+#include <vector>
+
+// Build from MDM/: g++ -std=c++20 -I. tests/ArgumentParserTest.cpp cli/ArgumentParser.cpp
+//   io/Decompressor.cpp core/ThreadPlacement.cpp -lz -pthread
+
+namespace {
+bool parse(std::vector<std::string> args, DownloadConfig& cfg, ArgumentParser& parser) {
+    args.insert(args.begin(), "mdm");
+    std::vector<char*> argv;
+    for (auto& a : args)
+        argv.push_back(a.data());
+    return parser.parse(static_cast<int>(argv.size()), argv.data(), cfg);
+}
+
+bool parse(std::vector<std::string> args) {
+    ArgumentParser parser;
+    DownloadConfig cfg;
+    return parse(std::move(args), cfg, parser);
+}
+}
+
+static void readsNumbers() {
+    ArgumentParser parser;
+    DownloadConfig cfg;
+    CHECK(parse({ "http://host/file.bin", "-t", "8", "-s", "1048576", "--sequential", "4194304" }, cfg, parser));
+    CHECK_EQ(cfg.maxThreads, 8u);
+    CHECK_EQ(cfg.segmentSize, 1048576u);
+    CHECK(!cfg.adaptiveSegments);
+    CHECK_EQ(cfg.sequentialWindow, 4194304u);
+    CHECK_EQ(cfg.outputPath, "file.bin");
+
+    ArgumentParser daemon;
+    CHECK(parse({ "--daemon", "/tmp/mdm.sock", "-c", "32", "-r", "1000000", "-j", "2" }, cfg, daemon));
+    CHECK_EQ(daemon.daemonConnections, 32u);
+    CHECK_EQ(daemon.daemonBytesPerSec, 1000000u);
+    CHECK_EQ(daemon.daemonJobs, 2u);
+}
+
+static void rejectsMalformedNumbers() {
+    // Must fail cleanly: the daemon parses submitted jobs with this and a
+    // thrown exception would take it down
+    CHECK(!parse({ "http://host/f", "-t", "abc" }));
+    CHECK(!parse({ "http://host/f", "-t", "4x" }));
+    CHECK(!parse({ "http://host/f", "-t", "" }));
+    CHECK(!parse({ "http://host/f", "-t", "-1" }));
+    CHECK(!parse({ "http://host/f", "-t", " 4" }));
+    CHECK(!parse({ "http://host/f", "-t", "99999999999999999999999" }));
+    CHECK(!parse({ "http://host/f", "-s", "1e6" }));
+    CHECK(!parse({ "http://host/f", "-s", "0" }));
+    CHECK(!parse({ "http://host/f", "--low-speed", "100", "q" }));
+    CHECK(!parse({ "--daemon", "/tmp/mdm.sock", "-c", "z" }));
+    CHECK(!parse({ "--daemon", "/tmp/mdm.sock", "-r", "1.5" }));
+    CHECK(!parse({ "--make-index", "file", "-b", "big" }));
+}
+
+static void rejectsMalformedCpuLists() {
+    ArgumentParser parser;
+    DownloadConfig cfg;
+    CHECK(parse({ "http://host/f", "--cpus-workers", "0-3,8" }, cfg, parser));
+    CHECK_EQ(cfg.workerCpus, "0-3,8");
+
+    CHECK(!parse({ "http://host/f", "--cpus-workers", "0-3x" }));
+    CHECK(!parse({ "http://host/f", "--cpus-writers", "3-1" }));
+    // An empty list would silently disable pinning
+    CHECK(!parse({ "http://host/f", "--cpus-logger", "," }));
+}
+
+int main() {
+    readsNumbers();
+    rejectsMalformedNumbers();
+    rejectsMalformedCpuLists();
+    return test::result();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <iostream>
+
+// Minimal checks for the standalone tests in this folder. Each test is its
+// own program with a main(), so they are not part of MDM.vcxproj; build one
+// together with the sources it exercises, e.g. from MDM/:
+//   g++ -std=c++20 -I. tests/RangeSetTest.cpp core/RangeSet.cpp -o rangeset && ./rangeset
+// The exit status is the number of failed checks.
+
+namespace test {
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline int result() {
+    std::cout << (failures() ? "FAILED\n" : "ok\n");
+    return failures();
+}
+}
+
+// Unlike assert() this keeps going and is not compiled out by NDEBUG
+#define CHECK(expr)                                                         \
+    do {                                                                    \
+        if (!(expr)) {                                                      \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #expr "\n";    \
+            ++test::failures();                                             \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
@@ -0,0 +1,179 @@
+#include "../io/DecompressSink.h"
+#include "Check.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+// Build from MDM/: g++ -std=c++20 -I. tests/DecompressSinkTest.cpp io/DecompressSink.cpp
+//   io/Decompressor.cpp io/TarExtractor.cpp io/ArchiveFormat.cpp io/OutputSink.cpp -lz -pthread
+
+namespace fs = std::filesystem;
+
+namespace {
+const fs::path kDir = fs::temp_directory_path() / "mdm-decompress-test";
+
+std::string gzip(const std::string& text) {
+    z_stream strm{};
+    deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&strm, static_cast<uLong>(text.size())), '\0');
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    strm.avail_in = static_cast<uInt>(text.size());
+    strm.next_out = reinterpret_cast<Bytef*>(out.data());
+    strm.avail_out = static_cast<uInt>(out.size());
+    deflate(&strm, Z_FINISH);
+    out.resize(out.size() - strm.avail_out);
+    deflateEnd(&strm);
+    return out;
+}
+
+std::string sample(std::size_t size) {
+    std::mt19937 rng(7);
+    std::string s(size, '\0');
+    // Compressible but not trivially so
+    for (auto& c : s)
+        c = static_cast<char>('a' + rng() % 8);
+    return s;
+}
+
+std::string read(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+struct Chunk {
+    std::uint64_t offset;
+    std::size_t size;
+};
+
+bool writeAll(DecompressSink& sink, const std::string& gz, const std::vector<Chunk>& chunks) {
+    for (const auto& c : chunks) {
+        if (!sink.write(c.offset, gz.data() + c.offset, c.size))
+            return false;
+    }
+    return true;
+}
+}
+
+static void decodesOutOfOrderChunks() {
+    const std::string text = sample(400000);
+    const std::string gz = gzip(text);
+    const std::size_t h = gz.size() / 2;
+    const std::size_t q = gz.size() / 4;
+
+    DecompressSink sink((kDir / "order.out").string(), CompressionFormat::Gzip, false, nullptr, 1 << 20);
+    CHECK(sink.open());
+    CHECK(writeAll(sink, gz, {
+        { h, gz.size() - h },
+        { q, h - q },
+        { 0, q },
+    }));
+    CHECK(sink.close());
+    CHECK(read(kDir / "order.out") == text);
+}
+
+static void toleratesDuplicateAndOverlappingWrites() {
+    const std::string text = sample(400000);
+    const std::string gz = gzip(text);
+    const std::size_t h = gz.size() / 2;
+    const std::size_t q = gz.size() / 4;
+
+    DecompressSink sink((kDir / "dup.out").string(), CompressionFormat::Gzip, false, nullptr, 1 << 20);
+    CHECK(sink.open());
+    CHECK(writeAll(sink, gz, {
+        { h, gz.size() - h },  // later half first
+        { h, 100 },            // shorter duplicate of a buffered key
+        { 0, q },              // prefix
+        { 0, q / 2 },          // stale retry below the frontier
+        { q / 2, h - q / 2 },  // retry overlapping the frontier
+        { h - 10, 50 },        // overlapping both halves
+    }));
+    CHECK(sink.close());
+    CHECK(read(kDir / "dup.out") == text);
+}
+
+static void manyWritersWithSmallBuffer() {
+    const std::string text = sample(2000000);
+    const std::string gz = gzip(text);
+    // Like download workers: each thread owns every fourth segment and
+    // writes it front to back in chunks
+    const std::size_t segment = 16384;
+    const std::size_t chunk = 4096;
+    const std::size_t threads = 4;
+
+    DecompressSink sink((kDir / "threads.out").string(), CompressionFormat::Gzip, false, nullptr, 3 * segment);
+    CHECK(sink.open());
+    std::vector<std::thread> writers;
+    std::atomic<bool> ok{ true };
+    for (std::size_t t = 0; t < threads; ++t) {
+        writers.emplace_back([&, t]() {
+            for (std::size_t seg = t * segment; seg < gz.size(); seg += threads * segment) {
+                const std::size_t end = std::min(seg + segment, gz.size());
+                for (std::size_t off = seg; off < end; off += chunk) {
+                    if (!sink.write(off, gz.data() + off, std::min(chunk, end - off)))
+                        ok = false;
+                }
+            }
+        });
+    }
+    for (auto& w : writers)
+        w.join();
+    CHECK(ok);
+    CHECK(sink.close());
+    CHECK(read(kDir / "threads.out") == text);
+}
+
+static void reportsMissingOrCorruptInput() {
+    const std::string text = sample(100000);
+    const std::string gz = gzip(text);
+    const std::size_t h = gz.size() / 2;
+
+    // A hole: the second half is never decoded
+    DecompressSink hole((kDir / "hole.out").string(), CompressionFormat::Gzip, false, nullptr, 1 << 20);
+    CHECK(hole.open());
+    CHECK(writeAll(hole, gz, { { 0, 100 }, { h, gz.size() - h } }));
+    CHECK(!hole.close());
+
+    // Truncated stream
+    DecompressSink cut((kDir / "cut.out").string(), CompressionFormat::Gzip, false, nullptr, 1 << 20);
+    CHECK(cut.open());
+    CHECK(writeAll(cut, gz, { { 0, h } }));
+    CHECK(!cut.close());
+
+    // Not gzip at all; the write may still succeed, close must not
+    const std::string junk(5000, 'x');
+    DecompressSink bad((kDir / "bad.out").string(), CompressionFormat::Gzip, false, nullptr, 1 << 20);
+    CHECK(bad.open());
+    bad.write(0, junk.data(), junk.size());
+    CHECK(!bad.close());
+}
+
+static void abortUnblocksWriters() {
+    const std::string gz = gzip(sample(100000));
+    DecompressSink sink((kDir / "abort.out").string(), CompressionFormat::Gzip, false, nullptr, 1024);
+    CHECK(sink.open());
+    // Far ahead of the frontier and over the buffer limit: blocks until aborted
+    std::thread writer([&]() { CHECK(!sink.write(10000, gz.data() + 10000, 4096)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sink.abort();
+    writer.join();
+    CHECK(!sink.close());
+}
+
+int main() {
+    fs::remove_all(kDir);
+    fs::create_directories(kDir);
+
+    decodesOutOfOrderChunks();
+    toleratesDuplicateAndOverlappingWrites();
+    manyWritersWithSmallBuffer();
+    reportsMissingOrCorruptInput();
+    abortUnblocksWriters();
+
+    fs::remove_all(kDir);
+    return test::result();
+}
@@ -0,0 +1,146 @@
+#include "../io/Decompressor.h"
+#include "Check.h"
+
+#include <zlib.h>
+
+// Build from MDM/: g++ -std=c++20 -I. tests/DecompressorTest.cpp io/Decompressor.cpp -lz
+
+namespace {
+// windowBits 31: gzip framing, -15: raw deflate as stored in ZIP
+std::string deflate(const std::string& text, int windowBits) {
+    z_stream strm{};
+    deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&strm, static_cast<uLong>(text.size())), '\0');
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    strm.avail_in = static_cast<uInt>(text.size());
+    strm.next_out = reinterpret_cast<Bytef*>(out.data());
+    strm.avail_out = static_cast<uInt>(out.size());
+    deflate(&strm, Z_FINISH);
+    out.resize(out.size() - strm.avail_out);
+    deflateEnd(&strm);
+    return out;
+}
+
+std::string gzip(const std::string& text) {
+    return deflate(text, 31);
+}
+
+bool decode(CompressionFormat format, const std::string& data, std::size_t step,
+    std::string& out, bool& finished) {
+    auto decoder = Decompressor::create(format);
+    if (!decoder)
+        return false;
+    out.clear();
+    auto sink = [&](const char* p, std::size_t n) {
+        out.append(p, n);
+        return true;
+    };
+    for (std::size_t i = 0; i < data.size(); i += step) {
+        if (!decoder->feed(data.data() + i, std::min(step, data.size() - i), sink))
+            return false;
+    }
+    finished = decoder->finished();
+    return true;
+}
+
+std::string sample(std::size_t size) {
+    std::string s;
+    for (std::size_t i = 0; s.size() < size; ++i)
+        s += "line " + std::to_string(i * 7919 % 1000) + "\n";
+    s.resize(size);
+    return s;
+}
+}
+
+static void decodesSingleMember() {
+    const std::string text = sample(300000); // more than one output buffer
+    const std::string gz = gzip(text);
+    for (std::size_t step : { gz.size(), std::size_t(1), std::size_t(4096) }) {
+        std::string out;
+        bool finished = false;
+        CHECK(decode(CompressionFormat::Gzip, gz, step, out, finished));
+        CHECK(finished);
+        CHECK(out == text);
+    }
+}
+
+static void decodesConcatenatedMembers() {
+    // As written by `cat a.gz b.gz` or pigz
+    const std::string a = sample(5000);
+    const std::string b = "second member\n";
+    const std::string c = sample(70000);
+    const std::string gz = gzip(a) + gzip(b) + gzip(c);
+
+    for (std::size_t step : { gz.size(), std::size_t(1), std::size_t(13) }) {
+        std::string out;
+        bool finished = false;
+        CHECK(decode(CompressionFormat::Gzip, gz, step, out, finished));
+        CHECK(finished);
+        CHECK(out == a + b + c);
+    }
+
+    // Members split across feeds exactly at the boundary
+    auto decoder = Decompressor::create(CompressionFormat::Gzip);
+    std::string out;
+    auto sink = [&](const char* p, std::size_t n) {
+        out.append(p, n);
+        return true;
+    };
+    const std::string first = gzip(a);
+    const std::string second = gzip(b);
+    CHECK(decoder->feed(first.data(), first.size(), sink));
+    CHECK(decoder->finished());
+    CHECK(decoder->feed(second.data(), 5, sink));
+    CHECK(!decoder->finished());
+    CHECK(decoder->feed(second.data() + 5, second.size() - 5, sink));
+    CHECK(decoder->finished());
+    CHECK(out == a + b);
+}
+
+static void detectsTruncatedAndCorruptInput() {
+    const std::string gz = gzip(sample(20000));
+    std::string out;
+    bool finished = true;
+
+    // Truncated: no error, but never finished
+    CHECK(decode(CompressionFormat::Gzip, gz.substr(0, gz.size() / 2), 100, out, finished));
+    CHECK(!finished);
+    CHECK(decode(CompressionFormat::Gzip, gz.substr(0, gz.size() - 4), 100, out, finished));
+    CHECK(!finished);
+
+    CHECK(!decode(CompressionFormat::Gzip, "this is not compressed at all", 64, out, finished));
+
+    // Garbage after a complete member is a broken second member
+    CHECK(!decode(CompressionFormat::Gzip, gz + "garbage!", 64, out, finished));
+
+    // A damaged trailer fails the checksum
+    std::string bad = gz;
+    bad[bad.size() - 6] ^= 0x55;
+    CHECK(!decode(CompressionFormat::Gzip, bad, 64, out, finished));
+}
+
+static void rawDeflateEndsWithItsStream() {
+    const std::string text = sample(10000);
+    const std::string raw = deflate(text, -15);
+    std::string out;
+    bool finished = false;
+    // Whatever follows a ZIP member's data is not part of it
+    CHECK(decode(CompressionFormat::Deflate, raw + "next local header", 7, out, finished));
+    CHECK(finished);
+    CHECK(out == text);
+}
+
+static void stopsWhenOutputFails() {
+    const std::string gz = gzip(sample(1000));
+    auto decoder = Decompressor::create(CompressionFormat::Gzip);
+    CHECK(!decoder->feed(gz.data(), gz.size(), [](const char*, std::size_t) { return false; }));
+}
+
+int main() {
+    decodesSingleMember();
+    decodesConcatenatedMembers();
+    detectsTruncatedAndCorruptInput();
+    rawDeflateEndsWithItsStream();
+    stopsWhenOutputFails();
+    return test::result();
+}
@@ -0,0 +1,131 @@
+#include "../io/MetadataStore.h"
+#include "Check.h"
+
+#include <filesystem>
+#include <fstream>
+
+// Build from MDM/: g++ -std=c++20 -I. tests/MetadataStoreTest.cpp io/MetadataStore.cpp core/RangeSet.cpp
+
+namespace fs = std::filesystem;
+
+namespace {
+const fs::path kDir = fs::temp_directory_path() / "mdm-metadata-test";
+
+std::string pathOf(const std::string& name) {
+    return (kDir / name).string();
+}
+
+void writeFile(const std::string& path, const std::string& text) {
+    std::ofstream(path, std::ios::trunc) << text;
+}
+}
+
+static void roundTrips() {
+    DownloadMetadata saved;
+    saved.url = "https://host/path/file.iso?x=1";
+    saved.etag = "\"abc-123\"";
+    saved.fileSize = 1ull << 40; // past 32 bits
+    saved.done.add(0, 4096);
+    saved.done.add(1ull << 32, (1ull << 32) + 100);
+    saved.done.add((1ull << 40) - 10, 1ull << 40);
+    saved.completedBytes = saved.done.bytes();
+
+    MetadataStore store(pathOf("full.mdm"));
+    CHECK(store.save(saved));
+    CHECK(store.exists());
+    CHECK(!fs::exists(pathOf("full.mdm.tmp")));
+
+    DownloadMetadata loaded;
+    CHECK(store.load(loaded));
+    CHECK_EQ(loaded.url, saved.url);
+    CHECK_EQ(loaded.etag, saved.etag);
+    CHECK_EQ(loaded.fileSize, saved.fileSize);
+    CHECK_EQ(loaded.completedBytes, saved.completedBytes);
+    CHECK(loaded.done.ranges() == saved.done.ranges());
+
+    // Durable saves write the same file
+    CHECK(store.save(saved, true));
+    DownloadMetadata again;
+    CHECK(store.load(again));
+    CHECK(again.done.ranges() == saved.done.ranges());
+
+    CHECK(store.remove());
+    CHECK(!store.exists());
+    CHECK(!store.load(again));
+}
+
+static void keepsEmptyEtagAndRanges() {
+    DownloadMetadata saved;
+    saved.url = "http://host/f";
+    saved.fileSize = 0;
+    saved.completedBytes = 0;
+
+    MetadataStore store(pathOf("empty.mdm"));
+    CHECK(store.save(saved));
+
+    DownloadMetadata loaded;
+    loaded.etag = "stale";
+    loaded.done.add(0, 5);
+    CHECK(store.load(loaded));
+    CHECK(loaded.etag.empty());
+    CHECK_EQ(loaded.done.count(), 0u);
+}
+
+static void rejectsMalformedFiles() {
+    const char* bad[] = {
+        // Pre-range layout without a header
+        "http://host/f\n-\n100\n0\n0\n",
+        "mdm-resume 2\nhttp://host/f\n-\n100\n0\n0\n",
+        "other 1\nhttp://host/f\n-\n100\n0\n0\n",
+        // Truncated range list
+        "mdm-resume 1\nhttp://host/f\n-\n100\n20\n2\n0 10\n",
+        // Range past the end, reversed range, non-numeric size
+        "mdm-resume 1\nhttp://host/f\n-\n100\n20\n1\n90 110\n",
+        "mdm-resume 1\nhttp://host/f\n-\n100\n10\n1\n20 10\n",
+        "mdm-resume 1\nhttp://host/f\n-\nbig\n0\n0\n",
+        // Byte count does not match the ranges
+        "mdm-resume 1\nhttp://host/f\n-\n100\n50\n1\n0 10\n",
+        "",
+    };
+    for (const char* text : bad) {
+        writeFile(pathOf("bad.mdm"), text);
+        DownloadMetadata loaded;
+        const bool ok = MetadataStore(pathOf("bad.mdm")).load(loaded);
+        CHECK(!ok);
+        if (ok)
+            std::cerr << "  accepted \"" << text << "\"\n";
+    }
+
+    // Overlapping ranges are merged, and the byte count is of the union
+    writeFile(pathOf("overlap.mdm"), "mdm-resume 1\nhttp://host/f\n-\n100\n30\n2\n0 20\n10 30\n");
+    DownloadMetadata loaded;
+    CHECK(MetadataStore(pathOf("overlap.mdm")).load(loaded));
+    CHECK_EQ(loaded.done.count(), 1u);
+}
+
+static void validatesAgainstRemote() {
+    MetadataStore store(pathOf("v.mdm"));
+    DownloadMetadata local;
+    local.fileSize = 100;
+    local.etag = "\"a\"";
+    CHECK(store.validate(local, "\"a\"", 100));
+    CHECK(!store.validate(local, "\"b\"", 100));
+    CHECK(!store.validate(local, "\"a\"", 101));
+
+    // Without a stored ETag only the size can be compared
+    local.etag.clear();
+    CHECK(store.validate(local, "\"b\"", 100));
+}
+
+int main() {
+    fs::remove_all(kDir);
+    fs::create_directories(kDir);
+
+    roundTrips();
+    keepsEmptyEtagAndRanges();
+    rejectsMalformedFiles();
+    validatesAgainstRemote();
+
+    fs::remove_all(kDir);
+    return test::result();
+}
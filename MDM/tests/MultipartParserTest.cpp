@@ -0,0 +1,108 @@
+#include "../net/MultipartParser.h"
+#include "Check.h"
+
+#include <map>
+#include <string>
+
+// Build from MDM/: g++ -std=c++20 -I. tests/MultipartParserTest.cpp net/MultipartParser.cpp
+
+namespace {
+const std::string kBody =
+    "preamble\r\n"
+    "--XyZ\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Range: bytes 10-14/100\r\n"
+    "\r\n"
+    "hello\r\n"
+    "--XyZ\r\n"
+    "content-range: bytes 50-61/100\r\n"
+    "\r\n"
+    "--XyZ\r\nworld\r\n"
+    "--XyZ--\r\n"
+    "epilogue";
+
+struct Collected {
+    std::map<std::uint64_t, std::string> parts;
+
+    MultipartParser::PartDataFn fn() {
+        return [this](std::uint64_t offset, const char* data, std::size_t size) {
+            // Consecutive chunks of one part are glued back together
+            for (auto& [start, bytes] : parts) {
+                if (start + bytes.size() == offset) {
+                    bytes.append(data, size);
+                    return true;
+                }
+            }
+            parts[offset].assign(data, size);
+            return true;
+        };
+    }
+};
+
+bool parse(const std::string& body, std::size_t step, Collected& out, bool& complete) {
+    MultipartParser parser("XyZ", out.fn());
+    for (std::size_t i = 0; i < body.size(); i += step) {
+        if (!parser.feed(body.data() + i, std::min(step, body.size() - i)))
+            return false;
+    }
+    complete = parser.complete();
+    return true;
+}
+}
+
+static void parsesPartsInAnyChunking() {
+    for (std::size_t step : { kBody.size(), std::size_t(1), std::size_t(7) }) {
+        Collected got;
+        bool complete = false;
+        CHECK(parse(kBody, step, got, complete));
+        CHECK(complete);
+        CHECK_EQ(got.parts.size(), 2u);
+        CHECK_EQ(got.parts[10], "hello");
+        // Body bytes are taken by length, even when they look like a delimiter
+        CHECK_EQ(got.parts[50], "--XyZ\r\nworld");
+    }
+}
+
+static void incompleteWithoutClosingDelimiter() {
+    Collected got;
+    bool complete = true;
+    CHECK(parse(kBody.substr(0, kBody.find("--XyZ--")), 5, got, complete));
+    CHECK(!complete);
+}
+
+static void rejectsMalformedParts() {
+    Collected got;
+    bool complete = false;
+
+    // No Content-Range
+    CHECK(!parse("--XyZ\r\nContent-Type: text/plain\r\n\r\nabc\r\n--XyZ--\r\n", 64, got, complete));
+    // Range not starting with a number, or ending before it starts
+    CHECK(!parse("--XyZ\r\nContent-Range: bytes x-4/10\r\n\r\n", 64, got, complete));
+    CHECK(!parse("--XyZ\r\nContent-Range: bytes 9-4/10\r\n\r\n", 64, got, complete));
+    CHECK(!parse("--XyZ\r\nContent-Range: items 0-4/10\r\n\r\n", 64, got, complete));
+    // A header line that never ends
+    CHECK(!parse("--XyZ\r\nContent-Range: " + std::string(20000, '1'), 1024, got, complete));
+}
+
+static void stopsWhenSinkFails() {
+    MultipartParser parser("XyZ", [](std::uint64_t, const char*, std::size_t) { return false; });
+    CHECK(!parser.feed(kBody.data(), kBody.size()));
+}
+
+static void extractsBoundary() {
+    CHECK_EQ(MultipartParser::boundaryFrom("multipart/byteranges; boundary=3d6b6a416f9b5"), "3d6b6a416f9b5");
+    CHECK_EQ(MultipartParser::boundaryFrom("Multipart/Byteranges; Boundary=\"a b\"; x=1"), "a b");
+    CHECK_EQ(MultipartParser::boundaryFrom("multipart/byteranges; boundary=abc \r\n"), "abc");
+    CHECK(MultipartParser::boundaryFrom("multipart/form-data; boundary=abc").empty());
+    CHECK(MultipartParser::boundaryFrom("multipart/byteranges").empty());
+    CHECK(MultipartParser::boundaryFrom("").empty());
+}
+
+int main() {
+    parsesPartsInAnyChunking();
+    incompleteWithoutClosingDelimiter();
+    rejectsMalformedParts();
+    stopsWhenSinkFails();
+    extractsBoundary();
+    return test::result();
+}
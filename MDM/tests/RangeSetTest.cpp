@@ -0,0 +1,75 @@
+#include "../core/RangeSet.h"
+#include "Check.h"
+
+// Build from MDM/: g++ -std=c++20 -I. tests/RangeSetTest.cpp core/RangeSet.cpp
+
+static void mergesOverlappingAndTouching() {
+    RangeSet set;
+    set.add(10, 20);
+    set.add(30, 40);
+    CHECK_EQ(set.count(), 2u);
+    CHECK_EQ(set.bytes(), 20u);
+
+    set.add(20, 30); // touches both neighbours
+    CHECK_EQ(set.count(), 1u);
+    CHECK_EQ(set.bytes(), 30u);
+    CHECK(set.covers(10, 40));
+
+    set.add(5, 15);
+    set.add(35, 50);
+    CHECK_EQ(set.count(), 1u);
+    CHECK_EQ(set.ranges().begin()->first, 5u);
+    CHECK_EQ(set.ranges().begin()->second, 50u);
+    CHECK_EQ(set.bytes(), 45u);
+
+    set.add(0, 100); // swallows everything
+    CHECK_EQ(set.count(), 1u);
+    CHECK_EQ(set.bytes(), 100u);
+}
+
+static void ignoresEmptyAndReversed() {
+    RangeSet set;
+    set.add(10, 10);
+    set.add(20, 5);
+    CHECK_EQ(set.count(), 0u);
+    CHECK_EQ(set.bytes(), 0u);
+    CHECK(set.covers(7, 7));
+    CHECK(!set.covers(0, 1));
+}
+
+static void coversNeedsOneRange() {
+    RangeSet set;
+    set.add(0, 10);
+    set.add(11, 20);
+    CHECK(set.covers(0, 10));
+    CHECK(set.covers(12, 20));
+    CHECK(!set.covers(5, 15)); // spans the hole at 10
+    CHECK(!set.covers(15, 21));
+}
+
+static void findsGaps() {
+    RangeSet set;
+    set.add(10, 20);
+    set.add(30, 40);
+
+    std::uint64_t b = 0, e = 0;
+    CHECK(set.nextGap(0, 100, b, e));
+    CHECK(b == 0 && e == 10);
+    CHECK(set.nextGap(15, 100, b, e));
+    CHECK(b == 20 && e == 30);
+    CHECK(set.nextGap(20, 25, b, e));
+    CHECK(b == 20 && e == 25);
+    CHECK(set.nextGap(35, 100, b, e));
+    CHECK(b == 40 && e == 100);
+    CHECK(!set.nextGap(10, 20, b, e));
+    CHECK(!set.nextGap(35, 40, b, e));
+    CHECK(!set.nextGap(50, 50, b, e));
+}
+
+int main() {
+    mergesOverlappingAndTouching();
+    ignoresEmptyAndReversed();
+    coversNeedsOneRange();
+    findsGaps();
+    return test::result();
+}
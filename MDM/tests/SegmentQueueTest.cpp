@@ -0,0 +1,195 @@
+#include "../core/SegmentQueue.h"
+#include "Check.h"
+
+// Build from MDM/: g++ -std=c++20 -I. tests/SegmentQueueTest.cpp core/SegmentQueue.cpp
+//   core/RangeSet.cpp core/SegmentSizer.cpp
+
+static void carvesFixedSegments() {
+    SegmentQueue queue(RangeSet{}, 1000, 300);
+    const std::uint64_t offsets[] = { 0, 300, 600, 900 };
+    const std::uint64_t sizes[] = { 300, 300, 300, 100 };
+
+    std::vector<Segment> got;
+    for (int i = 0; i < 4; ++i) {
+        auto seg = queue.getNext();
+        CHECK(seg.has_value());
+        if (!seg)
+            return;
+        CHECK_EQ(seg->offset, offsets[i]);
+        CHECK_EQ(seg->size, sizes[i]);
+        got.push_back(*seg);
+    }
+    CHECK(!queue.getNext());
+    CHECK(!queue.hasPending());
+    CHECK(!queue.allDone());
+
+    for (const auto& seg : got)
+        queue.markDone(seg.index);
+    CHECK(queue.allDone());
+    CHECK_EQ(queue.doneCount(), 4u);
+    CHECK_EQ(queue.contiguousPrefix(), 1000u);
+}
+
+static void carvesAroundDoneRanges() {
+    RangeSet done;
+    done.add(100, 200);
+    done.add(500, 1000);
+    SegmentQueue queue(done, 1000, 300);
+
+    auto a = queue.getNext();
+    auto b = queue.getNext();
+    CHECK(a && a->offset == 0 && a->size == 100);
+    CHECK(b && b->offset == 200 && b->size == 300);
+    CHECK(!queue.getNext());
+    CHECK_EQ(queue.contiguousPrefix(), 0u);
+
+    if (a && b) {
+        queue.markDone(a->index);
+        CHECK_EQ(queue.contiguousPrefix(), 200u);
+        queue.markDone(b->index);
+    }
+    CHECK(queue.allDone());
+    CHECK_EQ(queue.fragmentCount(), 1u);
+}
+
+static void emptyFileIsDone() {
+    SegmentQueue queue(RangeSet{}, 0, 300);
+    CHECK(queue.allDone());
+    CHECK(!queue.getNext());
+}
+
+static void partialKeepsPrefix() {
+    SegmentQueue queue(RangeSet{}, 1000, 1000);
+    auto seg = queue.getNext();
+    CHECK(seg.has_value());
+    if (!seg)
+        return;
+
+    queue.markPartial(seg->index, 400);
+    auto rest = queue.getNext();
+    CHECK(rest && rest->offset == 400 && rest->size == 600);
+    CHECK_EQ(queue.contiguousPrefix(), 400u);
+
+    // More than the segment is clamped, not counted twice
+    if (rest)
+        queue.markPartial(rest->index, 5000);
+    CHECK(queue.allDone());
+    CHECK(!queue.getNext());
+}
+
+static void failsAfterMaxAttempts() {
+    SegmentQueue queue(RangeSet{}, 100, 100);
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        auto seg = queue.getNext();
+        CHECK(seg && seg->offset == 0);
+        if (!seg)
+            return;
+        // Giving a segment back does not use up an attempt
+        queue.release(seg->index);
+        seg = queue.getNext();
+        CHECK(seg.has_value());
+        if (!seg)
+            return;
+        CHECK(!queue.hasFailed());
+        queue.markFailed(seg->index);
+    }
+    CHECK(queue.hasFailed());
+    CHECK(!queue.allDone());
+}
+
+static void windowHoldsBackLaterSegments() {
+    SegmentQueue queue(RangeSet{}, 1000, 100);
+    queue.setWindow(200);
+    auto a = queue.getNext();
+    auto b = queue.getNext();
+    CHECK(a && a->offset == 0);
+    CHECK(b && b->offset == 100);
+    if (!a || !b)
+        return;
+
+    // The prefix moved by 100, so the window now reaches 300
+    queue.markDone(a->index);
+    auto c = queue.getNext();
+    CHECK(c && c->offset == 200 && c->size == 100);
+}
+
+static void batchesSmallHoles() {
+    RangeSet done;
+    done.add(0, 100);
+    done.add(110, 500);
+    done.add(520, 1000);
+
+    SegmentQueue off(done, 1000, 300);
+    CHECK(off.getBatch(8, 64, 1 << 20).empty());
+
+    SegmentQueue queue(done, 1000, 300);
+    queue.setBatching(true);
+    auto batch = queue.getBatch(8, 64, 1 << 20);
+    CHECK_EQ(batch.size(), 2u);
+    if (batch.size() != 2)
+        return;
+    CHECK(batch[0].offset == 100 && batch[0].size == 10);
+    CHECK(batch[1].offset == 500 && batch[1].size == 20);
+    CHECK(batch[0].index != batch[1].index);
+    CHECK(!queue.getNext());
+
+    queue.markDone(batch[0].index);
+    queue.markDone(batch[1].index);
+    CHECK(queue.allDone());
+}
+
+static void batchNeedsTwoSmallSegments() {
+    RangeSet done;
+    done.add(0, 100);
+    done.add(110, 500);
+    SegmentQueue queue(done, 1000, 300);
+    queue.setBatching(true);
+
+    // The 500-byte tail is regular work, so only one hole qualifies
+    CHECK(queue.getBatch(8, 64, 1 << 20).empty());
+    auto a = queue.getNext();
+    CHECK(a && a->offset == 100 && a->size == 10);
+
+    // Byte budget: the second hole would not fit
+    RangeSet holes;
+    holes.add(0, 100);
+    holes.add(110, 500);
+    holes.add(520, 1000);
+    SegmentQueue small(holes, 1000, 300);
+    small.setBatching(true);
+    CHECK(small.getBatch(8, 64, 15).empty());
+}
+
+static void batchesRetries() {
+    SegmentQueue queue(RangeSet{}, 1000, 50);
+    queue.setBatching(true);
+
+    std::vector<Segment> segs;
+    for (int i = 0; i < 3; ++i)
+        segs.push_back(*queue.getNext());
+    queue.markFailed(segs[0].index);
+    queue.markFailed(segs[2].index);
+
+    auto batch = queue.getBatch(8, 64, 1 << 20);
+    // Both retries, then nothing from the untouched tail: it is one large gap
+    CHECK_EQ(batch.size(), 2u);
+    if (batch.size() == 2) {
+        CHECK_EQ(batch[0].index, segs[0].index);
+        CHECK_EQ(batch[1].index, segs[2].index);
+    }
+    auto next = queue.getNext();
+    CHECK(next && next->offset == 150);
+}
+
+int main() {
+    carvesFixedSegments();
+    carvesAroundDoneRanges();
+    emptyFileIsDone();
+    partialKeepsPrefix();
+    failsAfterMaxAttempts();
+    windowHoldsBackLaterSegments();
+    batchesSmallHoles();
+    batchNeedsTwoSmallSegments();
+    batchesRetries();
+    return test::result();
+}
@@ -0,0 +1,129 @@
+#include "../io/TarExtractor.h"
+#include "Check.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+// Build from MDM/: g++ -std=c++20 -I. tests/TarExtractorTest.cpp io/TarExtractor.cpp io/ArchiveFormat.cpp
+
+namespace fs = std::filesystem;
+
+namespace {
+const fs::path kDir = fs::temp_directory_path() / "mdm-tar-test";
+
+std::string header(const std::string& name, std::size_t size, char type = '0') {
+    std::string h(512, '\0');
+    std::memcpy(&h[0], name.data(), std::min<std::size_t>(name.size(), 100));
+    std::snprintf(&h[100], 8, "%07o", 0644);
+    std::snprintf(&h[124], 12, "%011zo", size);
+    h[156] = type;
+    std::memcpy(&h[257], "ustar", 6);
+    std::memset(&h[148], ' ', 8);
+    unsigned sum = 0;
+    for (unsigned char c : h)
+        sum += c;
+    std::snprintf(&h[148], 8, "%06o", sum);
+    return h;
+}
+
+std::string member(const std::string& name, const std::string& body, char type = '0') {
+    std::string m = header(name, body.size(), type) + body;
+    m.append((512 - body.size() % 512) % 512, '\0');
+    return m;
+}
+
+std::string end() {
+    return std::string(1024, '\0');
+}
+
+std::string read(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+bool extract(const std::string& archive, std::size_t step, const fs::path& dir, bool& finished) {
+    TarExtractor tar(dir.string());
+    for (std::size_t i = 0; i < archive.size(); i += step) {
+        if (!tar.feed(archive.data() + i, std::min(step, archive.size() - i)))
+            return false;
+    }
+    finished = tar.finish();
+    return true;
+}
+}
+
+static void joinsOnlyPathsBelowRoot() {
+    const std::string root = (kDir / "out").string();
+    CHECK_EQ(TarExtractor::safeJoin(root, "a/b.txt"), (kDir / "out" / "a" / "b.txt").string());
+    CHECK_EQ(TarExtractor::safeJoin(root, "./a//b.txt"), (kDir / "out" / "a" / "b.txt").string());
+    CHECK_EQ(TarExtractor::safeJoin(root, "dir/"), (kDir / "out" / "dir" / "").string());
+    CHECK_EQ(TarExtractor::safeJoin(root, "a..b"), (kDir / "out" / "a..b").string());
+
+    CHECK(TarExtractor::safeJoin(root, "").empty());
+    CHECK(TarExtractor::safeJoin(root, "/etc/passwd").empty());
+    CHECK(TarExtractor::safeJoin(root, "..").empty());
+    CHECK(TarExtractor::safeJoin(root, "../x").empty());
+    CHECK(TarExtractor::safeJoin(root, "a/../../x").empty());
+    // Even a harmless climb is refused rather than resolved
+    CHECK(TarExtractor::safeJoin(root, "a/../b").empty());
+}
+
+static void extractsAndSkipsUnsafeMembers() {
+    const std::string pax = "20 path=renamed.txt\n";
+    const std::string archive =
+        member("dir", "", '5')
+        + member("dir/a.txt", "hello")
+        + member("../evil.txt", "no")
+        + member("/abs.txt", "no")
+        + member("link", "", '2')
+        + member("pax", pax, 'x')
+        + member("long-name-replaced.txt", std::string(600, 'z'))
+        + end();
+
+    for (std::size_t step : { archive.size(), std::size_t(1), std::size_t(333) }) {
+        const fs::path out = kDir / ("out" + std::to_string(step));
+        fs::create_directories(out);
+        bool finished = false;
+        CHECK(extract(archive, step, out, finished));
+        CHECK(finished);
+        CHECK_EQ(read(out / "dir" / "a.txt"), "hello");
+        CHECK_EQ(read(out / "renamed.txt"), std::string(600, 'z'));
+        CHECK(!fs::exists(out / "long-name-replaced.txt"));
+        CHECK(!fs::exists(out / "link"));
+        CHECK(!fs::exists(kDir / "evil.txt"));
+        // Nothing but the two regular files was written
+        std::size_t files = 0;
+        for (const auto& entry : fs::recursive_directory_iterator(out))
+            files += entry.is_regular_file() ? 1 : 0;
+        CHECK_EQ(files, 2u);
+    }
+}
+
+static void rejectsCorruptArchives() {
+    const fs::path out = kDir / "corrupt";
+    fs::create_directories(out);
+    bool finished = true;
+
+    std::string bad = member("a.txt", "hello") + end();
+    bad[148] ^= 1; // checksum
+    CHECK(!extract(bad, bad.size(), out, finished));
+
+    // Cut inside a body: nothing fails until finish()
+    const std::string whole = member("b.txt", std::string(1000, 'b')) + end();
+    CHECK(extract(whole.substr(0, 700), 64, out, finished));
+    CHECK(!finished);
+}
+
+int main() {
+    fs::remove_all(kDir);
+    fs::create_directories(kDir);
+
+    joinsOnlyPathsBelowRoot();
+    extractsAndSkipsUnsafeMembers();
+    rejectsCorruptArchives();
+
+    fs::remove_all(kDir);
+    return test::result();
+}
@@ -0,0 +1,42 @@
+#include "../core/ThreadPlacement.h"
+#include "Check.h"
+
+// Build from MDM/: g++ -std=c++20 -I. tests/ThreadPlacementTest.cpp core/ThreadPlacement.cpp -pthread
+
+using ThreadPlacement::CpuSet;
+using ThreadPlacement::parseCpuList;
+
+static void parsesLists() {
+    CpuSet cpus;
+    CHECK(parseCpuList("0-3,8", cpus));
+    CHECK((cpus == CpuSet{ 0, 1, 2, 3, 8 }));
+
+    // Sorted and de-duplicated, blanks and empty items ignored
+    CHECK(parseCpuList(" 9 , 2-4,,3 ", cpus));
+    CHECK((cpus == CpuSet{ 2, 3, 4, 9 }));
+
+    CHECK(parseCpuList("5-5", cpus));
+    CHECK((cpus == CpuSet{ 5 }));
+
+    CHECK(parseCpuList("", cpus));
+    CHECK(cpus.empty());
+}
+
+static void rejectsMalformedLists() {
+    for (const char* bad : { "a", "0-3x", "3-1", "-1", "1-", "-", "1--2", "0x10", "1.5",
+             "1234567", "99999999999999999999" }) {
+        CpuSet cpus{ 42 };
+        const bool ok = parseCpuList(bad, cpus);
+        CHECK(!ok);
+        if (ok)
+            std::cerr << "  accepted \"" << bad << "\"\n";
+        // The output is left alone on failure
+        CHECK((cpus == CpuSet{ 42 }));
+    }
+}
+
+int main() {
+    parsesLists();
+    rejectsMalformedLists();
+    return test::result();
+}